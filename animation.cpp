@@ -0,0 +1,114 @@
+#include <algorithm>
+
+#include "animation.h"
+
+
+void AnimationTrack::addKeyframe(const Keyframe& keyframe) {
+
+	auto it = std::upper_bound(keyframes.begin(), keyframes.end(), keyframe,
+		[](const Keyframe& a, const Keyframe& b) { return a.time < b.time; });
+	keyframes.insert(it, keyframe);
+}
+
+
+Transform AnimationTrack::getTransform(float time) const {
+
+	if (keyframes.empty())
+		return Transform();
+
+	Keyframe pose = keyframes.front();
+
+	if (time >= keyframes.back().time) {
+		pose = keyframes.back();
+	}
+	else if (time > keyframes.front().time) {
+		auto next = std::upper_bound(keyframes.begin(), keyframes.end(), time,
+			[](float time, const Keyframe& k) { return time < k.time; });
+		const Keyframe& a = *(next - 1);
+		const Keyframe& b = *next;
+		float f = (time - a.time) / (b.time - a.time);
+
+		pose.position = a.position + (b.position - a.position) * f;
+		pose.rotation = a.rotation + (b.rotation - a.rotation) * f;
+		pose.scale = a.scale + (b.scale - a.scale) * f;
+	}
+
+	return Transform::translation(pose.position)
+		* Transform::rotation(Vector(0.0f, 0.0f, 1.0f), pose.rotation.z)
+		* Transform::rotation(Vector(0.0f, 1.0f, 0.0f), pose.rotation.y)
+		* Transform::rotation(Vector(1.0f, 0.0f, 0.0f), pose.rotation.x)
+		* Transform::scaling(pose.scale);
+}
+
+
+float AnimationTrack::getEndTime() const {
+	return keyframes.empty() ? 0.0f : keyframes.back().time;
+}
+
+
+
+void Animation::animatePrimitives(const Scene& scene, int firstPrimitive, int primitiveCount,
+	const AnimationTrack& track) {
+
+	BoundingBox box;
+	for (int id = firstPrimitive; id < firstPrimitive + primitiveCount; id++) {
+		BoundingBox primitiveBox;
+		if (scene.getPrimitiveBox(id, primitiveBox))
+			box.extend(primitiveBox);
+	}
+
+	Target target;
+	target.firstPrimitive = firstPrimitive;
+	target.primitiveCount = primitiveCount;
+	target.instance = NULL;
+	target.center = box.isEmpty() ? Point(0.0f) : box.centroid();
+	target.track = track;
+	targets.push_back(target);
+}
+
+
+void Animation::animateInstance(MeshInstance* instance, const AnimationTrack& track) {
+
+	BoundingBox box;
+	instance->getBoundingBox(box);
+
+	Target target;
+	target.firstPrimitive = 0;
+	target.primitiveCount = 0;
+	target.instance = instance;
+	target.restTransform = instance->getTransform();
+	target.center = box.isEmpty() ? Point(0.0f) : box.centroid();
+	target.track = track;
+	targets.push_back(target);
+}
+
+
+float Animation::getDuration() const {
+
+	float duration = 0.0f;
+	for (const auto& target: targets)
+		duration = std::max(duration, target.track.getEndTime());
+	return duration;
+}
+
+
+bool Animation::apply(Scene& scene, float time) const {
+
+	for (const auto& target: targets) {
+		Transform transform; // at rest
+		if (time >= 0.0f)
+			transform = Transform::translation(target.center)
+				* target.track.getTransform(time)
+				* Transform::translation(-target.center);
+
+		if (target.instance) {
+			target.instance->setTransform(transform * target.restTransform);
+			continue;
+		}
+
+		for (int id = target.firstPrimitive; id < target.firstPrimitive + target.primitiveCount; id++)
+			scene.setPrimitiveTransform(id, transform);
+	}
+
+	return scene.update();
+}
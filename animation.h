@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include "vectormath.h"
+#include "transform.h"
+#include "scene.h"
+#include "instance.h"
+
+
+// pose of an object at one point in time, relative to where it was put in
+// the scene: moved by position, rotated and scaled about its center
+struct Keyframe {
+	float time;      // seconds
+	Vector position; // offset
+	Vector rotation; // radians about x, then y, then z
+	float scale;
+
+	Keyframe(float time = 0.0f, const Vector& position = Vector(0.0f),
+		const Vector& rotation = Vector(0.0f), float scale = 1.0f)
+		: time(time), position(position), rotation(rotation), scale(scale) {}
+};
+
+
+// Keyframes of one object, interpolated linearly. Before the first and
+// after the last keyframe the object holds its pose.
+class AnimationTrack {
+protected:
+	std::vector<Keyframe> keyframes; // sorted by time
+
+public:
+	void addKeyframe(const Keyframe& keyframe);
+
+	// the pose at time about a center at the origin
+	Transform getTransform(float time) const;
+
+	float getEndTime() const;
+};
+
+
+// Moves objects of a built scene along their tracks, frame by frame. The
+// scene's BVH is refitted to the new poses and only rebuilt when that got
+// it too costly, see Scene::update().
+class Animation {
+protected:
+	struct Target {
+		int firstPrimitive, primitiveCount; // built in primitives of the scene
+		MeshInstance* instance;             // or an instance
+		Transform restTransform;            // of the instance
+		Point center;                       // rotations and scaling pivot here
+		AnimationTrack track;
+	};
+
+	std::vector<Target> targets;
+
+public:
+	// primitives [firstPrimitive, firstPrimitive + primitiveCount) of the
+	// scene move as one object, e.g. everything one Scene::addShape() added
+	void animatePrimitives(const Scene& scene, int firstPrimitive, int primitiveCount,
+		const AnimationTrack& track);
+
+	void animateInstance(MeshInstance* instance, const AnimationTrack& track);
+
+	// time of the last keyframe of all tracks
+	float getDuration() const;
+
+	// poses everything at time and updates the scene, returns true if the
+	// BVH had to be rebuilt. A negative time puts everything back where it
+	// was added to the scene.
+	bool apply(Scene& scene, float time) const;
+};
@@ -0,0 +1,539 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+
+#include "image.h"
+#include "camera.h"
+#include "shape.h"
+#include "scene.h"
+#include "triangleMesh.h"
+#include "objParser.h"
+#include "lightSet.h"
+#include "renderSettings.h"
+#include "rayPacket.h"
+#include "rayTrace.h"
+#include "denoise.h"
+
+
+// Benchmarks of the hot functions on their own and of whole frames of a few
+// standard scenes. Every measurement is repeated until it ran for a while
+// and the fastest repetition counts. Results go to stdout and, with
+// --json, to a file that later runs can be compared against.
+//
+// usage: benchmark [--json results.json] [--threads N] [--width N] [--height N]
+
+
+typedef std::chrono::steady_clock Clock;
+
+const double MIN_SECONDS = 0.25; // per measurement
+const int RAY_SET_SIZE = 4096;   // rays the kernel benchmarks cycle through
+
+
+// keeps the compiler from dropping the benchmarked calls
+static volatile long long sink;
+
+
+// seconds of the fastest of the repetitions of run, which are made until
+// MIN_SECONDS passed (but at least 3)
+template<typename Function>
+double measure(Function run) {
+
+	double best = 1e30, total = 0.0;
+	for (int repetition=0; repetition < 3 || total < MIN_SECONDS; repetition++) {
+		Clock::time_point start = Clock::now();
+		run();
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		best = std::min(best, seconds);
+		total += seconds;
+	}
+	return best;
+}
+
+
+// one line of the report, in the units of its kind
+struct Result {
+	std::string name;
+	std::string unit;
+	double value;
+
+	// full frames only, rays traced per frame by kind
+	long long primaryRays, shadowRays, secondaryRays;
+	double seconds;
+};
+
+
+// Forwards everything to the scene it wraps and counts the rays by what
+// they are for. The renderer asks for primary hits with intersectPacket()
+// (or intersect() at depth 0 without packets), shadow rays with occluded()
+// and everything else, reflections, refractions and light through glass,
+// with intersect(). Not thread safe, the counting frame runs on one thread.
+class RayCounter : public Shape {
+protected:
+	Shape* scene;
+
+public:
+	long long primary, shadow, secondary;
+
+	RayCounter(Shape* scene) : scene(scene), primary(0), shadow(0), secondary(0) {}
+
+	virtual bool intersect(Intersection& intersection) {
+		secondary++;
+		return scene->intersect(intersection);
+	}
+
+	virtual void intersectPacket(RayPacket& packet) {
+		primary += __builtin_popcount(packet.activeMask);
+		scene->intersectPacket(packet);
+	}
+
+	virtual bool occluded(const Ray& ray, float maxDistance, const MaterialProperty*& lens) {
+		shadow++;
+		return scene->occluded(ray, maxDistance, lens);
+	}
+
+	// hits name the shape that was hit, so these are never called on the counter
+	virtual bool doesIntersect(const Ray& ray) { return scene->doesIntersect(ray); }
+	virtual Vector getNormalVector(const Point& pHit) { return scene->getNormalVector(pHit); }
+	virtual const MaterialProperty& getMaterialProperty() { return scene->getMaterialProperty(); }
+	virtual bool getBoundingBox(BoundingBox& box) { return scene->getBoundingBox(box); }
+};
+
+
+
+// rays from random points around the origin towards random points of a
+// smaller cube, so that about half of them hit a unit sized shape there
+std::vector<Ray> makeRaySet() {
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> around(-3.0f, 3.0f), target(-1.0f, 1.0f);
+
+	std::vector<Ray> rays(RAY_SET_SIZE);
+	for (auto& ray: rays) {
+		Point origin(around(random), around(random), around(random) - 6.0f);
+		Point to(target(random), target(random), target(random));
+		ray = Ray(origin, (to - origin).normalized());
+	}
+	return rays;
+}
+
+
+// Mrays/s of shape->intersect() over the ray set
+Result benchmarkIntersect(const std::string& name, Shape* shape, const std::vector<Ray>& rays) {
+
+	const int rounds = 64;
+	double seconds = measure([&]() {
+		long long hits = 0;
+		for (int round=0; round < rounds; round++) {
+			for (const Ray& ray: rays) {
+				Intersection intersection(ray);
+				hits += shape->intersect(intersection);
+			}
+		}
+		sink = hits;
+	});
+
+	return { name, "Mrays/s", rounds * rays.size() / seconds * 1e-6, 0, 0, 0, seconds };
+}
+
+
+Result benchmarkMakeRay() {
+
+	PerspectiveCamera camera(Point(-5.0f, 1.0f, 0.0f), Vector(0.0f, 1.0f, 0.0f),
+		Vector(), M_PI / 4, 16.0f / 9.0f);
+
+	const int width = 1024, height = 1024;
+	double seconds = measure([&]() {
+		float sum = 0.0f;
+		for (int y=0; y < height; y++) {
+			for (int x=0; x < width; x++) {
+				Ray ray = camera.makeRay(Vector2(2.0f * x / width - 1.0f, 1.0f - 2.0f * y / height));
+				sum += ray.direction.x;
+			}
+		}
+		sink = (long long)sum;
+	});
+
+	return { "PerspectiveCamera::makeRay", "Mrays/s", (double)width * height / seconds * 1e-6, 0, 0, 0, seconds };
+}
+
+
+Result benchmarkObjParser(const std::string& fileName, int threadCount) {
+
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	double megabytes = file.tellg() * 1e-6;
+
+	// the parser reports every file it parses
+	std::streambuf* out = std::cout.rdbuf(NULL);
+	double seconds = measure([&]() {
+		ObjParser parser(fileName, threadCount);
+		sink = parser.indices.size();
+	});
+	std::cout.rdbuf(out);
+
+	return { "ObjParser " + fileName, "MB/s", megabytes / seconds, 0, 0, 0, seconds };
+}
+
+
+Result benchmarkSaveImagePPM() {
+
+	const int width = 1920, height = 1080;
+	const char* fileName = "benchmark.ppm";
+
+	Image image(width, height);
+	for (int y=0; y < height; y++)
+		for (int x=0; x < width; x++)
+			*image.getPixel(x, y) = Color(x / (float)width, y / (float)height, 0.5f);
+
+	// and so does saveImage()
+	std::streambuf* out = std::cout.rdbuf(NULL);
+	double seconds = measure([&]() {
+		image.saveImagePPM(fileName);
+	});
+	std::cout.rdbuf(out);
+	std::remove(fileName);
+
+	return { "Image::saveImagePPM 1920x1080", "Mpixels/s", (double)width * height / seconds * 1e-6, 0, 0, 0, seconds };
+}
+
+
+
+// a scene to render as a whole, the shapes are owned by it
+struct BenchmarkScene {
+	std::string name;
+	Scene scene;
+	std::vector<std::unique_ptr<Shape>> shapes;
+	Point cameraPosition, cameraTarget;
+	Vector cameraUp;
+	LightSet lights;
+
+	void add(Shape* shape) {
+		shapes.emplace_back(shape);
+		scene.addShape(shape);
+	}
+};
+
+
+// the scene of main.cpp
+void makeSphereScene(BenchmarkScene& s) {
+
+	s.name = "spheres";
+	s.add(new Plane(Point(0.0f, 0.0f, 0.0f), Vector(), Color(0.4f, 1.0f, 0.4f), 0.1f));
+	s.add(new Sphere(Point(0.0f, 1.0f, 0.0f), 1.0f, Color(0.9f, 0.3f, 0.2f), 0.7f));
+	s.add(new Sphere(Point(7.0f, 7.0f, -5.0f), 2.0f, Color(0.6f, 0.8f, 0.9f), 1.0f));
+	s.add(new Sphere(Point(5.0f, 4.0f, 0.0f), 3.0f, Color(0.2f, 0.1f, 1.0f), 0.8f));
+	s.add(new Sphere(Point(3.0f, 3.0f, 7.0f), 2.3f, Color(0.8f, 0.8f, 0.0f), 0.7f));
+	s.add(new Sphere(Point(-2.0f, 1.3f, 1.2f), 1.0f, Color(0.02f, 0.0f, 0.0f), 0.01f, 1.0f, 1.5f));
+
+	s.cameraPosition = Point(-5.0f, 1.0f, 0.0f);
+	s.cameraTarget = Point(0.0f, 1.0f, 0.0f);
+	s.lights.addLight(LightSource(Vector(5.0f, 15.0f, 4.0f), 270.0f));
+}
+
+
+// every triangle of pumpkin.obj, looked at from the side it faces
+bool makePumpkinScene(BenchmarkScene& s, int threadCount) {
+
+	s.name = "pumpkin";
+
+	std::streambuf* out = std::cout.rdbuf(NULL);
+	ObjParser parser("pumpkin.obj", threadCount);
+	std::cout.rdbuf(out);
+	if (parser.indices.empty())
+		return false;
+
+	TriangleMesh* pumpkin = new TriangleMesh(parser.vertices, parser.indices, Color(0.9f, 0.2f, 0.1f));
+	s.add(pumpkin);
+
+	BoundingBox box;
+	pumpkin->getBoundingBox(box);
+	Vector size = box.max - box.min;
+	float radius = size.length() * 0.5f;
+
+	s.cameraTarget = box.centroid();
+	s.cameraPosition = s.cameraTarget + Vector(0.0f, -1.4f * radius, 0.4f * radius);
+	s.cameraUp = Vector(0.0f, 0.0f, 1.0f); // the mesh is z up
+	s.lights.addLight(LightSource(s.cameraTarget + Vector(radius, -2.0f * radius, 3.0f * radius),
+		10.0f * radius * radius));
+	return true;
+}
+
+
+// a 32 x 32 grid of small mirror spheres on a floor, lots of secondary rays
+void makeManySphereScene(BenchmarkScene& s) {
+
+	s.name = "many spheres";
+	s.add(new Plane(Point(0.0f, 0.0f, 0.0f), Vector(), Color(0.4f, 1.0f, 0.4f), 0.1f));
+
+	const int n = 32;
+	for (int i=0; i < n * n; i++) {
+		float x = 2.0f + (i % n) * 0.7f, z = (i / n - n / 2) * 0.7f;
+		Color color(0.2f + 0.7f * (i % 3 == 0), 0.2f + 0.7f * (i % 3 == 1), 0.2f + 0.7f * (i % 3 == 2));
+		s.add(new Sphere(Point(x, 0.3f, z), 0.3f, color, 0.6f));
+	}
+
+	s.cameraPosition = Point(-3.0f, 6.0f, 0.0f);
+	s.cameraTarget = Point(12.0f, 0.0f, 0.0f);
+	s.lights.addLight(LightSource(Vector(5.0f, 15.0f, 4.0f), 270.0f));
+}
+
+
+// a floor with a few spheres under a grid of lightCount point, spot and
+// sphere lights of the same total brightness. With the light tree picking
+// one light per hit the time per frame should barely grow with the count.
+void makeManyLightScene(BenchmarkScene& s, int lightCount) {
+
+	s.name = "lights " + std::to_string(lightCount);
+	s.add(new Plane(Point(0.0f, 0.0f, 0.0f), Vector(), Color(0.8f, 0.8f, 0.8f), 0.1f));
+	for (int i=0; i < 9; i++)
+		s.add(new Sphere(Point(4.0f + (i % 3) * 3.0f, 1.0f, (i / 3 - 1) * 3.0f), 1.0f,
+			Color(0.9f, 0.3f + 0.2f * (i % 3), 0.2f), 0.3f));
+
+	int n = std::ceil(std::sqrt((float)lightCount));
+	float brightness = 270.0f / lightCount;
+	for (int i=0; i < lightCount; i++) {
+		Vector position(2.0f + (i % n) * 12.0f / n, 6.0f, (i / n - n / 2) * 12.0f / n);
+		if (i % 3 == 0)
+			s.lights.addLight(LightSource(position, brightness));
+		else if (i % 3 == 1)
+			s.lights.addLight(makeSpotLight(position, Vector(0.0f, -1.0f, 0.0f), M_PI / 6, M_PI / 4, brightness));
+		else
+			s.lights.addLight(makeSphereLight(position, 0.2f, brightness));
+	}
+
+	s.cameraPosition = Point(-5.0f, 4.0f, 0.0f);
+	s.cameraTarget = Point(7.0f, 0.0f, 0.0f);
+}
+
+
+// one ray per pixel, the rays are counted in a first frame on one thread,
+// the later ones are timed
+Result benchmarkFrame(BenchmarkScene& s, int width, int height, const RenderSettings& settings) {
+
+	s.scene.build();
+	s.lights.build();
+
+	PerspectiveCamera camera(s.cameraPosition, s.cameraTarget, s.cameraUp,
+		M_PI / 4, (float)width / height);
+	Image image(width, height);
+
+	RenderSettings counting = settings;
+	counting.threadCount = 1;
+	RayCounter counter(&s.scene);
+	rayTrace(image, &camera, &counter, s.lights, counting);
+
+	double seconds = measure([&]() {
+		rayTrace(image, &camera, &s.scene, s.lights, settings);
+	});
+
+	long long rays = counter.primary + counter.shadow + counter.secondary;
+	return { "frame " + s.name, "Mrays/s", rays / seconds * 1e-6,
+		counter.primary, counter.shadow, counter.secondary, seconds };
+}
+
+
+
+// root mean square difference of the displayable colors, 0 to 1
+double imageError(Image& image, Image& reference) {
+
+	double sum = 0.0;
+	for (int y=0; y < image.getHeight(); y++) {
+		for (int x=0; x < image.getWidth(); x++) {
+			const Color& a = *image.getPixel(x, y);
+			const Color& b = *reference.getPixel(x, y);
+			const float channels[][2] = { { a.r, b.r }, { a.g, b.g }, { a.b, b.b } };
+			for (auto& c: channels) {
+				double d = std::min(std::max(c[0], 0.0f), 1.0f) - std::min(std::max(c[1], 0.0f), 1.0f);
+				sum += d * d;
+			}
+		}
+	}
+	return std::sqrt(sum / (3.0 * image.getWidth() * image.getHeight()));
+}
+
+
+// the filter on its own, and how close a few samples per pixel denoised
+// get to REFERENCE_SAMPLES per pixel against brute force with more samples
+const int REFERENCE_SAMPLES = 64;
+
+void benchmarkDenoise(BenchmarkScene& s, int width, int height, const RenderSettings& settings,
+	const std::function<void(const Result&)>& report) {
+
+	s.scene.build();
+	s.lights.build();
+
+	PerspectiveCamera camera(s.cameraPosition, s.cameraTarget, s.cameraUp,
+		M_PI / 4, (float)width / height);
+
+	// every pixel gets all of its samples
+	auto samples = [&](int count) {
+		RenderSettings sampled = settings;
+		sampled.maxSamples = count;
+		sampled.aaThreshold = 0.0f;
+		return sampled;
+	};
+
+	Image reference(width, height);
+	rayTrace(reference, &camera, &s.scene, s.lights, samples(REFERENCE_SAMPLES));
+
+	Image image(width, height), noisy(width, height);
+	AOVBuffers aovs;
+	rayTrace(noisy, &camera, &s.scene, s.lights, samples(1), &aovs);
+	double seconds = measure([&]() {
+		std::copy(noisy.getPixel(0, 0), noisy.getPixel(0, 0) + width * height, image.getPixel(0, 0));
+		denoiseImage(image, aovs, DenoiseSettings(), settings.threadCount);
+	});
+	report({ "denoise " + s.name, "Mpixels/s", (double)width * height / seconds * 1e-6, 0, 0, 0, seconds });
+
+	for (int count: { 1, 4 }) {
+		seconds = measure([&]() {
+			rayTrace(image, &camera, &s.scene, s.lights, samples(count), &aovs);
+			denoiseImage(image, aovs, DenoiseSettings(), settings.threadCount);
+		});
+		report({ std::to_string(count) + " spp denoised " + s.name, "% RMSE", 100.0 * imageError(image, reference), 0, 0, 0, seconds });
+	}
+	for (int count: { 4, 16 }) {
+		seconds = measure([&]() {
+			rayTrace(image, &camera, &s.scene, s.lights, samples(count));
+		});
+		report({ std::to_string(count) + " spp " + s.name, "% RMSE", 100.0 * imageError(image, reference), 0, 0, 0, seconds });
+	}
+}
+
+
+
+void printResult(const Result& result) {
+
+	printf("%-36s %10.2f %s", result.name.c_str(), result.value, result.unit.c_str());
+	if (result.primaryRays > 0) {
+		double perSecond = 1e-6 / result.seconds;
+		printf("  (primary %.2f, shadow %.2f, secondary %.2f Mrays/s, %.1f ms/frame)",
+			result.primaryRays * perSecond, result.shadowRays * perSecond,
+			result.secondaryRays * perSecond, result.seconds * 1e3);
+	}
+	else if (result.unit == "% RMSE")
+		printf("  (%.1f ms/frame)", result.seconds * 1e3);
+	printf("\n");
+}
+
+
+bool writeJSON(const std::string& fileName, const std::vector<Result>& results,
+	int width, int height, int threadCount) {
+
+	FILE* file = fopen(fileName.c_str(), "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "{\n  \"width\": %d,\n  \"height\": %d,\n  \"threads\": %d,\n  \"kernels\": \"%s\",\n  \"results\": [\n",
+		width, height, threadCount, packetKernels->isa);
+
+	for (size_t i=0; i < results.size(); i++) {
+		const Result& r = results[i];
+		fprintf(file, "    { \"name\": \"%s\", \"unit\": \"%s\", \"value\": %.4f, \"seconds\": %.6f",
+			r.name.c_str(), r.unit.c_str(), r.value, r.seconds);
+		if (r.primaryRays > 0) {
+			fprintf(file, ",\n      \"rays\": { \"primary\": %lld, \"shadow\": %lld, \"secondary\": %lld },\n",
+				r.primaryRays, r.shadowRays, r.secondaryRays);
+			fprintf(file, "      \"mrays_per_second\": { \"primary\": %.4f, \"shadow\": %.4f, \"secondary\": %.4f }",
+				r.primaryRays / r.seconds * 1e-6, r.shadowRays / r.seconds * 1e-6,
+				r.secondaryRays / r.seconds * 1e-6);
+		}
+		fprintf(file, " }%s\n", i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(file, "  ]\n}\n");
+	return fclose(file) == 0;
+}
+
+
+
+int main(int argc, char** argv)
+{
+	std::string jsonFileName;
+	RenderSettings settings;
+	int width = 640;
+	int height = 360;
+
+	for (int i=1; i < argc; i++) {
+		if (!strcmp(argv[i], "--json") && i+1 < argc)
+			jsonFileName = argv[++i];
+		else if (!strcmp(argv[i], "--threads") && i+1 < argc)
+			settings.threadCount = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--width") && i+1 < argc)
+			width = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--height") && i+1 < argc)
+			height = atoi(argv[++i]);
+		else {
+			std::cerr << "usage: benchmark [--json results.json] [--threads N] [--width N] [--height N]" << std::endl;
+			return 1;
+		}
+	}
+
+	printf("packet kernels: %s\n\n", packetKernels->isa);
+
+	std::vector<Result> results;
+	auto report = [&](const Result& result) {
+		printResult(result);
+		fflush(stdout);
+		results.push_back(result);
+	};
+
+	std::vector<Ray> rays = makeRaySet();
+
+	Sphere sphere(Point(0.0f), 1.0f);
+	report(benchmarkIntersect("Sphere::intersect", &sphere, rays));
+
+	Point vertices[] = { Point(-1.0f, -1.0f, 0.0f), Point(1.0f, -1.0f, 0.0f), Point(0.0f, 1.0f, 0.0f) };
+	Triangle triangle(vertices);
+	report(benchmarkIntersect("Triangle::intersect", &triangle, rays));
+
+	Plane plane(Point(0.0f), Vector(0.3f, 1.0f, 0.2f).normalized());
+	report(benchmarkIntersect("Plane::intersect", &plane, rays));
+
+	report(benchmarkMakeRay());
+	bool havePumpkin = std::ifstream("pumpkin.obj").good();
+	if (havePumpkin)
+		report(benchmarkObjParser("pumpkin.obj", settings.threadCount));
+	report(benchmarkSaveImagePPM());
+
+	{
+		BenchmarkScene s;
+		makeSphereScene(s);
+		report(benchmarkFrame(s, width, height, settings));
+	}
+	if (havePumpkin) {
+		BenchmarkScene s;
+		if (makePumpkinScene(s, settings.threadCount))
+			report(benchmarkFrame(s, width, height, settings));
+	}
+	else
+		std::cerr << "pumpkin.obj not found, skipping the benchmarks that need it" << std::endl;
+	{
+		BenchmarkScene s;
+		makeManySphereScene(s);
+		report(benchmarkFrame(s, width, height, settings));
+	}
+	for (int lightCount: { 1, 16, 256, 4096 }) {
+		BenchmarkScene s;
+		makeManyLightScene(s, lightCount);
+		report(benchmarkFrame(s, width, height, settings));
+	}
+	{
+		BenchmarkScene s;
+		makeManyLightScene(s, 256);
+		benchmarkDenoise(s, width, height, settings, report);
+	}
+
+	if (!jsonFileName.empty()) {
+		int threadCount = TileScheduler(settings.threadCount).getThreadCount();
+		if (!writeJSON(jsonFileName, results, width, height, threadCount)) {
+			std::cerr << "couldn't write " << jsonFileName << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote the results to " << jsonFileName << std::endl;
+	}
+}
@@ -0,0 +1,55 @@
+#include <algorithm>
+
+#include "boundingBox.h"
+
+
+BoundingBox::BoundingBox()
+	: min(1.0e30f),
+	max(-1.0e30f)
+{
+}
+
+BoundingBox::BoundingBox(const Point& min, const Point& max)
+	: min(min),
+	max(max)
+{
+}
+
+void BoundingBox::extend(const Point& p)
+{
+	min = Point(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+	max = Point(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+}
+
+void BoundingBox::extend(const BoundingBox& box)
+{
+	min = Point(std::min(min.x, box.min.x), std::min(min.y, box.min.y), std::min(min.z, box.min.z));
+	max = Point(std::max(max.x, box.max.x), std::max(max.y, box.max.y), std::max(max.z, box.max.z));
+}
+
+bool BoundingBox::isEmpty() const
+{
+	return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+Point BoundingBox::centroid() const
+{
+	return (min + max) * 0.5f;
+}
+
+float BoundingBox::surfaceArea() const
+{
+	if (isEmpty())
+		return 0.0f;
+
+	Vector d = max - min;
+	return 2.0f * (d.x*d.y + d.y*d.z + d.z*d.x);
+}
+
+int BoundingBox::largestAxis() const
+{
+	Vector d = max - min;
+	if (d.x >= d.y && d.x >= d.z)
+		return 0;
+	return (d.y >= d.z) ? 1 : 2;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "vectormath.h"
+
+
+// axis aligned bounding box, an empty box has min > max so that
+// extending it with the first point gives a degenerate box at that point
+struct BoundingBox
+{
+	Point min, max;
+
+	BoundingBox();
+	BoundingBox(const Point& min, const Point& max);
+
+	void extend(const Point& p);
+	void extend(const BoundingBox& box);
+
+	bool isEmpty() const;
+	Point centroid() const;
+	float surfaceArea() const;
+	int largestAxis() const;
+};
+
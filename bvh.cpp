@@ -0,0 +1,208 @@
+#include <algorithm>
+
+#include "bvh.h"
+#include "trace.h"
+
+
+// relative cost of visiting a node vs intersecting a primitive, used by SAH
+const float BVH_TRAVERSAL_COST = 1.0f;
+const float BVH_INTERSECTION_COST = 1.0f;
+const int BVH_BIN_COUNT = 16;
+
+
+struct BVHBin {
+	BoundingBox box;
+	int count = 0;
+};
+
+
+BVH::BVH()
+	: nodes(NULL), indices(NULL), nodeCount(0), primitiveCount(0)
+{
+}
+
+
+void BVH::build(const std::vector<BoundingBox>& boxes) {
+
+	TRACE_SCOPE("bvh build");
+
+	nodeStorage.clear();
+	indexStorage.resize(boxes.size());
+	attach(NULL, 0, NULL, 0);
+
+	if (boxes.empty())
+		return;
+
+	std::vector<Point> centroids(boxes.size());
+	for (size_t i=0; i < boxes.size(); i++) {
+		indexStorage[i] = i;
+		centroids[i] = boxes[i].centroid();
+	}
+
+	// a binary tree with n leaves has 2n - 1 nodes
+	nodeStorage.reserve(2 * boxes.size());
+	buildNode(boxes, centroids, 0, boxes.size(), 0);
+
+	attach(nodeStorage.data(), nodeStorage.size(), indexStorage.data(), indexStorage.size());
+}
+
+
+void BVH::attach(const BVHNode* nodes, int nodeCount, const int* indices, int primitiveCount) {
+
+	this->nodes = nodes;
+	this->nodeCount = nodeCount;
+	this->indices = indices;
+	this->primitiveCount = primitiveCount;
+}
+
+
+BoundingBox BVH::getBounds() const {
+
+	return isEmpty() ? BoundingBox() : nodes[0].getBox();
+}
+
+
+void BVH::refit(const std::vector<BoundingBox>& boxes) {
+
+	TRACE_SCOPE("bvh refit");
+
+	// children always come after their parent, so going backwards every
+	// node sees its children already refitted
+	for (int i = nodeStorage.size() - 1; i >= 0; i--) {
+		BVHNode& node = nodeStorage[i];
+		BoundingBox box;
+
+		if (node.isLeaf()) {
+			for (int j = node.offset; j < node.offset + node.count; j++)
+				box.extend(boxes[indexStorage[j]]);
+		}
+		else {
+			box.extend(nodeStorage[i + 1].getBox());
+			box.extend(nodeStorage[node.offset].getBox());
+		}
+
+		node.setBox(box);
+	}
+}
+
+
+float BVH::getCost() const {
+
+	if (nodeCount == 0)
+		return 0.0f;
+
+	float rootArea = nodes[0].getBox().surfaceArea();
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	float cost = 0.0f;
+	for (int i=0; i < nodeCount; i++) {
+		const BVHNode& node = nodes[i];
+		float probability = node.getBox().surfaceArea() / rootArea;
+		cost += probability * (node.isLeaf() ? BVH_INTERSECTION_COST * node.count : BVH_TRAVERSAL_COST);
+	}
+
+	return cost;
+}
+
+
+int BVH::buildNode(const std::vector<BoundingBox>& boxes,
+	const std::vector<Point>& centroids, int start, int end, int depth) {
+
+	int nodeIndex = nodeStorage.size();
+	nodeStorage.push_back(BVHNode());
+
+	BoundingBox box, centroidBox;
+	for (int i = start; i < end; i++) {
+		box.extend(boxes[indexStorage[i]]);
+		centroidBox.extend(centroids[indexStorage[i]]);
+	}
+
+	int count = end - start;
+	nodeStorage[nodeIndex].setBox(box);
+	nodeStorage[nodeIndex].offset = start;
+	nodeStorage[nodeIndex].count = count;
+
+	if (count == 1 || depth >= BVH_MAX_DEPTH - 1)
+		return nodeIndex;
+
+	// find the cheapest split plane among the bin boundaries of all axes
+	float leafCost = BVH_INTERSECTION_COST * count;
+	float bestCost = RAY_T_MAX;
+	int bestAxis = -1, bestSplit = 0;
+
+	for (int axis=0; axis < 3; axis++) {
+
+		float axisMin = centroidBox.min[axis];
+		float extent = centroidBox.max[axis] - axisMin;
+		if (extent <= 0.0f)
+			continue; // all centroids on one plane, can't split along this axis
+
+		BVHBin bins[BVH_BIN_COUNT];
+		float scale = BVH_BIN_COUNT / extent;
+		for (int i = start; i < end; i++) {
+			int b = std::min(BVH_BIN_COUNT - 1, (int)((centroids[indexStorage[i]][axis] - axisMin) * scale));
+			bins[b].count++;
+			bins[b].box.extend(boxes[indexStorage[i]]);
+		}
+
+		// sweep from the right to get the area and count right of every boundary
+		float rightArea[BVH_BIN_COUNT];
+		int rightCount[BVH_BIN_COUNT];
+		BoundingBox rightBox;
+		int sum = 0;
+		for (int b = BVH_BIN_COUNT - 1; b > 0; b--) {
+			rightBox.extend(bins[b].box);
+			sum += bins[b].count;
+			rightArea[b] = rightBox.surfaceArea();
+			rightCount[b] = sum;
+		}
+
+		// then from the left, boundary b lies between bin b-1 and bin b
+		BoundingBox leftBox;
+		sum = 0;
+		for (int b = 1; b < BVH_BIN_COUNT; b++) {
+			leftBox.extend(bins[b-1].box);
+			sum += bins[b-1].count;
+			if (sum == 0 || rightCount[b] == 0)
+				continue;
+
+			float cost = BVH_TRAVERSAL_COST + BVH_INTERSECTION_COST *
+				(leftBox.surfaceArea() * sum + rightArea[b] * rightCount[b]) / box.surfaceArea();
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	int mid;
+
+	if (bestAxis == -1) {
+		// every centroid coincides, SAH has nothing to work with
+		if (count <= BVH_MAX_LEAF_SIZE)
+			return nodeIndex;
+		mid = start + count / 2;
+	}
+	else {
+		if (bestCost >= leafCost && count <= BVH_MAX_LEAF_SIZE)
+			return nodeIndex;
+
+		float axisMin = centroidBox.min[bestAxis];
+		float scale = BVH_BIN_COUNT / (centroidBox.max[bestAxis] - axisMin);
+		auto it = std::partition(indexStorage.begin() + start, indexStorage.begin() + end, [&](int i) {
+			int b = std::min(BVH_BIN_COUNT - 1, (int)((centroids[i][bestAxis] - axisMin) * scale));
+			return b < bestSplit;
+		});
+		mid = it - indexStorage.begin();
+	}
+
+	buildNode(boxes, centroids, start, mid, depth + 1); // left child lands at nodeIndex + 1
+	int right = buildNode(boxes, centroids, mid, end, depth + 1);
+
+	nodeStorage[nodeIndex].offset = right;
+	nodeStorage[nodeIndex].count = 0;
+
+	return nodeIndex;
+}
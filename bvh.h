@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "boundingBox.h"
+#include "ray.h"
+#include "rayPacket.h"
+#include "shape.h"
+#include "stats.h"
+
+
+// max number of primitives the builder puts in a leaf, and the depth after
+// which it stops splitting. Depth also bounds the traversal stack.
+const int BVH_MAX_LEAF_SIZE = 4;
+const int BVH_MAX_DEPTH = 64;
+
+
+// nodes are stored depth first so the left child of an interior node is
+// always the node right after it, only the right child needs an index.
+// The bounds are plain floats so that nodes can be written to disk and
+// mapped back in as they are (see meshCache.h).
+struct BVHNode {
+	float min[3], max[3];
+	int offset; // leaf: first entry in BVH::indices, interior: right child
+	int count;  // number of primitives in a leaf, 0 for interior nodes
+
+	bool isLeaf() const { return count > 0; }
+
+	BoundingBox getBox() const {
+		return BoundingBox(Point(min[0], min[1], min[2]), Point(max[0], max[1], max[2]));
+	}
+
+	void setBox(const BoundingBox& box) {
+		min[0] = box.min.x; min[1] = box.min.y; min[2] = box.min.z;
+		max[0] = box.max.x; max[1] = box.max.y; max[2] = box.max.z;
+	}
+
+	// slab test, invDirection is 1/direction which the caller computes
+	// once per ray instead of once per node
+	inline bool intersect(const Point& origin, const Vector& invDirection,
+		float tMax, float& tEntry) const;
+};
+
+
+// bounding volume hierarchy over an arbitrary list of primitives which are
+// only known by their bounding boxes. Owners (the shape set, meshes) supply
+// the intersection routine for a single primitive during traversal.
+class BVH {
+protected:
+	// either filled by build() or pointing at memory someone else owns
+	const BVHNode* nodes;
+	const int* indices; // primitive ids in leaf order
+	int nodeCount, primitiveCount;
+
+	std::vector<BVHNode> nodeStorage;
+	std::vector<int> indexStorage;
+
+public:
+	BVH();
+
+	BVH(const BVH&) = delete;
+	BVH& operator =(const BVH&) = delete;
+
+	// surface area heuristic build with binned split candidates on all 3 axes
+	void build(const std::vector<BoundingBox>& boxes);
+
+	// use a tree built earlier and stored elsewhere, e.g. in a mapped cache
+	// file, which has to outlive the BVH
+	void attach(const BVHNode* nodes, int nodeCount, const int* indices, int primitiveCount);
+
+	// moves the node bounds to new boxes of the same primitives, in the
+	// order build() got them, bottom up. The tree stays as it is, so it is
+	// much cheaper than a build but gets worse the more things moved.
+	// Only for trees build() made.
+	void refit(const std::vector<BoundingBox>& boxes);
+
+	// surface area heuristic cost: the expected number of nodes visited and
+	// primitives tested by a ray that hits the root box. Refits that stretch
+	// the nodes make it grow.
+	float getCost() const;
+
+	bool isEmpty() const { return nodeCount == 0; }
+	BoundingBox getBounds() const;
+
+	const BVHNode* getNodes() const { return nodes; }
+	const int* getIndices() const { return indices; }
+	int getNodeCount() const { return nodeCount; }
+	int getPrimitiveCount() const { return primitiveCount; }
+
+	// closest hit: intersectPrimitive(id, intersection) shrinks intersection.t
+	// on every hit, which in turn culls the remaining nodes
+	template <typename PrimitiveFunc>
+	bool intersect(Intersection& intersection, PrimitiveFunc intersectPrimitive) const;
+
+	// any hit: stops at the first primitive for which doesIntersectPrimitive(id, ray) is true
+	template <typename PrimitiveFunc>
+	bool doesIntersect(const Ray& ray, PrimitiveFunc doesIntersectPrimitive) const;
+
+	// closest hit for a packet, a node is entered if any of its rays hit
+	// it: intersectPrimitive(id, packet)
+	template <typename PrimitiveFunc>
+	void intersectPacket(RayPacket& packet, PrimitiveFunc intersectPrimitive) const;
+
+private:
+	int buildNode(const std::vector<BoundingBox>& boxes,
+		const std::vector<Point>& centroids, int start, int end, int depth);
+};
+
+
+
+inline bool BVHNode::intersect(const Point& origin, const Vector& invDirection,
+	float tMax, float& tEntry) const {
+
+	float t0 = (min[0] - origin.x) * invDirection.x;
+	float t1 = (max[0] - origin.x) * invDirection.x;
+	float tNear = std::min(t0, t1);
+	float tFar = std::max(t0, t1);
+
+	t0 = (min[1] - origin.y) * invDirection.y;
+	t1 = (max[1] - origin.y) * invDirection.y;
+	tNear = std::max(tNear, std::min(t0, t1));
+	tFar = std::min(tFar, std::max(t0, t1));
+
+	t0 = (min[2] - origin.z) * invDirection.z;
+	t1 = (max[2] - origin.z) * invDirection.z;
+	tNear = std::max(tNear, std::min(t0, t1));
+	tFar = std::min(tFar, std::max(t0, t1));
+
+	tEntry = tNear;
+	return tNear <= tFar && tFar > 0.0f && tNear < tMax;
+}
+
+
+template <typename PrimitiveFunc>
+bool BVH::intersect(Intersection& intersection, PrimitiveFunc intersectPrimitive) const {
+
+	if (nodeCount == 0)
+		return false;
+
+	const Ray& ray = intersection.ray;
+	Vector invDirection = 1.0f / ray.direction;
+	float tEntry;
+
+	if (!nodes[0].intersect(ray.origin, invDirection, intersection.t, tEntry))
+		return false;
+
+	bool intersects = false;
+	int stack[BVH_MAX_DEPTH + 1];
+	int stackSize = 0;
+	int nodeIndex = 0;
+
+	while (true) {
+		const BVHNode& node = nodes[nodeIndex];
+		STATS_COUNT(STAT_BVH_NODES);
+
+		if (node.isLeaf()) {
+			for (int i = node.offset; i < node.offset + node.count; i++) {
+				if (intersectPrimitive(indices[i], intersection))
+					intersects = true;
+			}
+		}
+		else {
+			int left = nodeIndex + 1;
+			int right = node.offset;
+			float tLeft, tRight;
+			bool hitLeft = nodes[left].intersect(ray.origin, invDirection, intersection.t, tLeft);
+			bool hitRight = nodes[right].intersect(ray.origin, invDirection, intersection.t, tRight);
+
+			if (hitLeft && hitRight) {
+				// visit the nearer child first so that the farther one
+				// is more likely to be culled by then
+				if (tRight < tLeft)
+					std::swap(left, right);
+				stack[stackSize++] = right;
+				nodeIndex = left;
+				continue;
+			}
+			if (hitLeft || hitRight) {
+				nodeIndex = hitLeft ? left : right;
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		nodeIndex = stack[--stackSize];
+	}
+
+	return intersects;
+}
+
+
+template <typename PrimitiveFunc>
+bool BVH::doesIntersect(const Ray& ray, PrimitiveFunc doesIntersectPrimitive) const {
+
+	if (nodeCount == 0)
+		return false;
+
+	Vector invDirection = 1.0f / ray.direction;
+	float tEntry;
+
+	int stack[BVH_MAX_DEPTH + 1];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		int nodeIndex = stack[--stackSize];
+		const BVHNode& node = nodes[nodeIndex];
+		STATS_COUNT(STAT_BVH_NODES);
+
+		if (!node.intersect(ray.origin, invDirection, ray.tMax, tEntry))
+			continue;
+
+		if (node.isLeaf()) {
+			for (int i = node.offset; i < node.offset + node.count; i++) {
+				if (doesIntersectPrimitive(indices[i], ray))
+					return true;
+			}
+		}
+		else {
+			// order doesn't matter much here, any blocker ends the search
+			stack[stackSize++] = node.offset;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+
+	return false;
+}
+
+
+template <typename PrimitiveFunc>
+void BVH::intersectPacket(RayPacket& packet, PrimitiveFunc intersectPrimitive) const {
+
+	float tEntry;
+
+	if (nodeCount == 0 || !intersectBoxPacket(packet, nodes[0].min, nodes[0].max, tEntry))
+		return;
+
+	int stack[BVH_MAX_DEPTH + 1];
+	int stackSize = 0;
+	int nodeIndex = 0;
+
+	while (true) {
+		const BVHNode& node = nodes[nodeIndex];
+		STATS_COUNT(STAT_BVH_PACKET_NODES);
+
+		if (node.isLeaf()) {
+			for (int i = node.offset; i < node.offset + node.count; i++)
+				intersectPrimitive(indices[i], packet);
+		}
+		else {
+			int left = nodeIndex + 1;
+			int right = node.offset;
+			float tLeft, tRight;
+			bool hitLeft = intersectBoxPacket(packet, nodes[left].min, nodes[left].max, tLeft);
+			bool hitRight = intersectBoxPacket(packet, nodes[right].min, nodes[right].max, tRight);
+
+			if (hitLeft && hitRight) {
+				if (tRight < tLeft)
+					std::swap(left, right);
+				stack[stackSize++] = right;
+				nodeIndex = left;
+				continue;
+			}
+			if (hitLeft || hitRight) {
+				nodeIndex = hitLeft ? left : right;
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		nodeIndex = stack[--stackSize];
+	}
+}
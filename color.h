@@ -1,45 +1,69 @@
 #pragma once
 
+// header only and trivially copyable, see vectormath.h
+
 struct Color
 {
-	float r, g, b;
-
-	Color();
-	Color(float l);
-	Color(float r, float g, float b);
+	float r = 0.0f, g = 0.0f, b = 0.0f;
 
-	virtual ~Color();
+	constexpr Color() {}
+	constexpr Color(float l) : r(l), g(l), b(l) {}
+	constexpr Color(float r, float g, float b) : r(r), g(g), b(b) {}
 
-	Color& operator =(const Color& c);
-	Color& operator +=(const Color& c);
-	Color& operator *=(const Color& c);
-	Color& operator *=(float f);
+	inline Color& operator +=(const Color& c);
+	inline Color& operator *=(const Color& c);
+	inline Color& operator *=(float f);
 };
 
-inline Color operator +(const Color& c1, const Color& c2)
+constexpr Color operator +(const Color& c1, const Color& c2)
 {
 	return Color(c1.r + c2.r,
 		c1.g + c2.g,
 		c1.b + c2.b);
 }
 
-inline Color operator *(const Color& c1, const Color& c2)
+constexpr Color operator *(const Color& c1, const Color& c2)
 {
 	return Color(c1.r * c2.r,
 		c1.g * c2.g,
 		c1.b * c2.b);
 }
 
-inline Color operator *(const Color& c, float f)
+constexpr Color operator *(const Color& c, float f)
 {
 	return Color(c.r * f,
 		c.g * f,
 		c.b * f);
 }
 
-inline Color operator *(float f, const Color& c)
+constexpr Color operator *(float f, const Color& c)
 {
 	return Color(f * c.r,
 		f * c.g,
 		f * c.b);
 }
+
+
+inline Color& Color::operator +=(const Color& c)
+{
+	r += c.r;
+	g += c.g;
+	b += c.b;
+	return *this;
+}
+
+inline Color& Color::operator *=(const Color& c)
+{
+	r *= c.r;
+	g *= c.g;
+	b *= c.b;
+	return *this;
+}
+
+inline Color& Color::operator *=(float f)
+{
+	r *= f;
+	g *= f;
+	b *= f;
+	return *this;
+}
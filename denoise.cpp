@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "denoise.h"
+#include "tileScheduler.h"
+#include "trace.h"
+
+
+void AOVBuffers::resize(const Image& image) {
+
+	width = image.getWidth();
+	firstRow = image.getFirstRow();
+	rowCount = image.getRowCount();
+
+	size_t size = (size_t)width * rowCount;
+	for (int c=0; c < 3; c++) {
+		normal[c].assign(size, 0.0f);
+		albedo[c].assign(size, 0.0f);
+	}
+	depth.assign(size, 0.0f);
+}
+
+
+void AOVBuffers::set(int x, int y, const SurfaceFeatures& features) {
+
+	size_t i = index(x, y);
+	normal[0][i] = features.normal.x;
+	normal[1][i] = features.normal.y;
+	normal[2][i] = features.normal.z;
+	albedo[0][i] = features.albedo.r;
+	albedo[1][i] = features.albedo.g;
+	albedo[2][i] = features.albedo.b;
+	depth[i] = features.depth;
+}
+
+
+SurfaceFeatures AOVBuffers::get(int x, int y) const {
+
+	size_t i = index(x, y);
+	SurfaceFeatures features;
+	features.normal = Vector(normal[0][i], normal[1][i], normal[2][i]);
+	features.albedo = Color(albedo[0][i], albedo[1][i], albedo[2][i]);
+	features.depth = depth[i];
+	return features;
+}
+
+
+
+// B3 spline, the 5x5 kernel is the outer product with itself
+static const float KERNEL[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+
+// keeps the depth weight of a pixel whose rays missed finite
+const float MIN_DEPTH2 = 1e-12f;
+
+// of the colors around a pixel, so flat regions still get filtered a bit
+const float MIN_VARIANCE = 0.05f;
+
+
+// below this approxExp() is 0, weights that small would only make the
+// sums denormal, which is very slow
+const float MIN_EXPONENT = -60.0f;
+
+
+// e^x for x <= 0, to about 2e-4. 2^(x log2 e) split into 2^integer, which
+// goes straight into the exponent bits, and 2^fraction by its Taylor
+// series. The SSE2 version below does the same 4 at a time.
+static inline float approxExp(float x) {
+
+	if (x < MIN_EXPONENT)
+		return 0.0f;
+
+	float t = x * 1.44269504f;
+	float i = std::floor(t);
+	float f = (t - i) * 0.69314718f;
+
+	float p = 1.0f + f * (1.0f + f * (1.0f / 2 + f * (1.0f / 6 + f * (1.0f / 24 + f * (1.0f / 120)))));
+
+	union { float f; int i; } scale;
+	scale.i = ((int)i + 127) << 23;
+	return p * scale.f;
+}
+
+
+#if defined(__SSE2__)
+static inline __m128 approxExp(__m128 x) {
+
+	__m128 inRange = _mm_cmpge_ps(x, _mm_set1_ps(MIN_EXPONENT));
+	__m128 t = _mm_mul_ps(_mm_max_ps(x, _mm_set1_ps(MIN_EXPONENT)), _mm_set1_ps(1.44269504f));
+
+	// truncation rounds negative numbers up, floor is one below that
+	__m128 i = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+	i = _mm_sub_ps(i, _mm_and_ps(_mm_cmpgt_ps(i, t), _mm_set1_ps(1.0f)));
+	__m128 f = _mm_mul_ps(_mm_sub_ps(t, i), _mm_set1_ps(0.69314718f));
+
+	__m128 p = _mm_set1_ps(1.0f / 120);
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f / 24));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f / 6));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f / 2));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+
+	__m128i scale = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(i), _mm_set1_epi32(127)), 23);
+	return _mm_and_ps(_mm_mul_ps(p, _mm_castsi128_ps(scale)), inRange);
+}
+#endif
+
+
+// 1 / variance of the brightness of the 5x5 pixels around every pixel of
+// the rows [y0, y1), so the color differences are measured against the
+// noise there. Edges count as noise too, the features keep those.
+static void noiseScales(const std::vector<float> color[3], int width, int rows, int y0, int y1, float* scales) {
+
+	for (int y = y0; y < y1; y++) {
+		for (int x=0; x < width; x++) {
+			float sum = 0.0f, sum2 = 0.0f;
+			int count = 0;
+			for (int qy = std::max(0, y-2); qy <= std::min(rows-1, y+2); qy++) {
+				for (int qx = std::max(0, x-2); qx <= std::min(width-1, x+2); qx++) {
+					size_t q = qx + (size_t)qy * width;
+					float brightness = (color[0][q] + color[1][q] + color[2][q]) / 3.0f;
+					sum += brightness;
+					sum2 += brightness * brightness;
+					count++;
+				}
+			}
+			float mean = sum / count;
+			float variance = std::max(0.0f, sum2 / count - mean * mean);
+			scales[x + (size_t)y * width] = 1.0f / (variance + MIN_VARIANCE);
+		}
+	}
+}
+
+
+// one pass of the filter, from color to filtered. Rows are counted from
+// the first row of the buffers.
+struct FilterPass {
+	int width, rows;
+	int step; // pixels between the taps
+
+	const float* color[3];
+	float* filtered[3];
+	const float* normal[3];
+	const float* albedo[3];
+	const float* depth;
+	const float* colorScales; // per pixel, see noiseScales()
+
+	// 1 / sigma^2
+	float colorScale, normalScale, albedoScale, depthScale;
+
+	// of the depth difference of the taps 1 and 2 away, since the depth
+	// changes with the distance on screen
+	float tapDepthScale[3];
+
+	void filterPixel(int x, int y) const;
+#if defined(__SSE2__)
+	void filterPixels4(int x, int y) const;
+#endif
+	void filterRows(int y0, int y1) const;
+};
+
+
+void FilterPass::filterPixel(int x, int y) const {
+
+	size_t p = x + (size_t)y * width;
+	float centerDepthScale = depthScale / std::max(depth[p] * depth[p], MIN_DEPTH2);
+	float pixelColorScale = colorScale * colorScales[p];
+
+	// the tap on the pixel itself differs in nothing, so it only has its
+	// kernel weight
+	float weightSum = KERNEL[2] * KERNEL[2];
+	float sum[3];
+	for (int c=0; c < 3; c++)
+		sum[c] = weightSum * color[c][p];
+
+	for (int dy = -2; dy <= 2; dy++) {
+		int qy = y + dy * step;
+		if (qy < 0 || qy >= rows)
+			continue;
+
+		for (int dx = -2; dx <= 2; dx++) {
+			int qx = x + dx * step;
+			if (qx < 0 || qx >= width || (dx == 0 && dy == 0))
+				continue;
+
+			size_t q = qx + (size_t)qy * width;
+			float colorDistance = 0.0f, normalDistance = 0.0f, albedoDistance = 0.0f;
+			for (int c=0; c < 3; c++) {
+				float d = color[c][q] - color[c][p];
+				colorDistance += d * d;
+				d = normal[c][q] - normal[c][p];
+				normalDistance += d * d;
+				d = albedo[c][q] - albedo[c][p];
+				albedoDistance += d * d;
+			}
+			float depthDistance = depth[q] - depth[p];
+			depthDistance *= depthDistance;
+
+			float exponent = colorDistance * pixelColorScale + normalDistance * normalScale
+				+ albedoDistance * albedoScale
+				+ depthDistance * centerDepthScale * tapDepthScale[std::max(std::abs(dx), std::abs(dy))];
+			float weight = KERNEL[dx + 2] * KERNEL[dy + 2] * approxExp(-exponent);
+
+			weightSum += weight;
+			for (int c=0; c < 3; c++)
+				sum[c] += weight * color[c][q];
+		}
+	}
+
+	for (int c=0; c < 3; c++)
+		filtered[c][p] = sum[c] / weightSum;
+}
+
+
+#if defined(__SSE2__)
+// the same for the pixels x to x+3 of row y, whose taps all have to be
+// within the row
+void FilterPass::filterPixels4(int x, int y) const {
+
+	size_t p = x + (size_t)y * width;
+
+	__m128 centerColor[3], centerNormal[3], centerAlbedo[3];
+	for (int c=0; c < 3; c++) {
+		centerColor[c] = _mm_loadu_ps(color[c] + p);
+		centerNormal[c] = _mm_loadu_ps(normal[c] + p);
+		centerAlbedo[c] = _mm_loadu_ps(albedo[c] + p);
+	}
+	__m128 centerDepth = _mm_loadu_ps(depth + p);
+	__m128 centerDepthScale = _mm_div_ps(_mm_set1_ps(depthScale),
+		_mm_max_ps(_mm_mul_ps(centerDepth, centerDepth), _mm_set1_ps(MIN_DEPTH2)));
+
+	__m128 centerColorScale = _mm_mul_ps(_mm_set1_ps(colorScale), _mm_loadu_ps(colorScales + p));
+
+	__m128 weightSum = _mm_set1_ps(KERNEL[2] * KERNEL[2]);
+	__m128 sum[3];
+	for (int c=0; c < 3; c++)
+		sum[c] = _mm_mul_ps(weightSum, centerColor[c]);
+
+	auto distance = [](__m128 a, __m128 b) {
+		__m128 d = _mm_sub_ps(a, b);
+		return _mm_mul_ps(d, d);
+	};
+
+	for (int dy = -2; dy <= 2; dy++) {
+		int qy = y + dy * step;
+		if (qy < 0 || qy >= rows)
+			continue;
+
+		for (int dx = -2; dx <= 2; dx++) {
+			if (dx == 0 && dy == 0)
+				continue;
+
+			size_t q = x + dx * step + (size_t)qy * width;
+			__m128 tapColor[3];
+			__m128 colorDistance = _mm_setzero_ps(), normalDistance = _mm_setzero_ps(),
+				albedoDistance = _mm_setzero_ps();
+			for (int c=0; c < 3; c++) {
+				tapColor[c] = _mm_loadu_ps(color[c] + q);
+				colorDistance = _mm_add_ps(colorDistance, distance(tapColor[c], centerColor[c]));
+				normalDistance = _mm_add_ps(normalDistance, distance(_mm_loadu_ps(normal[c] + q), centerNormal[c]));
+				albedoDistance = _mm_add_ps(albedoDistance, distance(_mm_loadu_ps(albedo[c] + q), centerAlbedo[c]));
+			}
+			__m128 depthDistance = distance(_mm_loadu_ps(depth + q), centerDepth);
+
+			__m128 exponent = _mm_mul_ps(colorDistance, centerColorScale);
+			exponent = _mm_add_ps(exponent, _mm_mul_ps(normalDistance, _mm_set1_ps(normalScale)));
+			exponent = _mm_add_ps(exponent, _mm_mul_ps(albedoDistance, _mm_set1_ps(albedoScale)));
+			exponent = _mm_add_ps(exponent, _mm_mul_ps(_mm_mul_ps(depthDistance, centerDepthScale),
+				_mm_set1_ps(tapDepthScale[std::max(std::abs(dx), std::abs(dy))])));
+
+			__m128 weight = _mm_mul_ps(_mm_set1_ps(KERNEL[dx + 2] * KERNEL[dy + 2]),
+				approxExp(_mm_sub_ps(_mm_setzero_ps(), exponent)));
+
+			weightSum = _mm_add_ps(weightSum, weight);
+			for (int c=0; c < 3; c++)
+				sum[c] = _mm_add_ps(sum[c], _mm_mul_ps(weight, tapColor[c]));
+		}
+	}
+
+	for (int c=0; c < 3; c++)
+		_mm_storeu_ps(filtered[c] + p, _mm_div_ps(sum[c], weightSum));
+}
+#endif
+
+
+void FilterPass::filterRows(int y0, int y1) const {
+
+	for (int y = y0; y < y1; y++) {
+		int x = 0;
+#if defined(__SSE2__)
+		// the pixels whose taps are all within the row, 4 at a time
+		int border = 2 * step;
+		for (; x < border && x < width; x++)
+			filterPixel(x, y);
+		for (; x + 4 + border <= width; x += 4)
+			filterPixels4(x, y);
+#endif
+		for (; x < width; x++)
+			filterPixel(x, y);
+	}
+}
+
+
+
+void denoiseImage(Image& image, const AOVBuffers& aovs, const DenoiseSettings& settings, int threadCount) {
+
+	TRACE_SCOPE("denoise");
+
+	int width = image.getWidth(), rows = image.getRowCount(), firstRow = image.getFirstRow();
+	if (aovs.getWidth() != width || aovs.getRowCount() != rows || aovs.getFirstRow() != firstRow
+		|| settings.iterations <= 0 || rows == 0)
+		return;
+
+	// two sets of color planes, the passes go back and forth between them
+	size_t size = (size_t)width * rows;
+	std::vector<float> planes[2][3];
+	for (int c=0; c < 3; c++) {
+		planes[0][c].resize(size);
+		planes[1][c].resize(size);
+	}
+
+	const Color* pixels = image.getPixel(0, firstRow);
+	for (size_t i=0; i < size; i++) {
+		planes[0][0][i] = pixels[i].r;
+		planes[0][1][i] = pixels[i].g;
+		planes[0][2][i] = pixels[i].b;
+	}
+
+	FilterPass pass;
+	pass.width = width;
+	pass.rows = rows;
+	for (int c=0; c < 3; c++) {
+		pass.normal[c] = aovs.normal[c].data();
+		pass.albedo[c] = aovs.albedo[c].data();
+	}
+	pass.depth = aovs.depth.data();
+	pass.normalScale = 1.0f / (settings.normalSigma * settings.normalSigma);
+	pass.albedoScale = 1.0f / (settings.albedoSigma * settings.albedoSigma);
+	pass.tapDepthScale[0] = 0.0f; // the pixel itself
+	pass.tapDepthScale[1] = 1.0f;
+	pass.tapDepthScale[2] = 1.0f / 4;
+
+	// strips of rows, the cost per pixel is about the same everywhere
+	TileScheduler scheduler(threadCount);
+	std::vector<Tile> strips;
+	for (int y=0; y < rows; y += 16)
+		strips.push_back({ 0, y, width, std::min(y + 16, rows) });
+
+	std::vector<float> colorScales(size);
+	scheduler.run(strips, [&](const Tile& strip, int thread) {
+		noiseScales(planes[0], width, rows, strip.y0, strip.y1, colorScales.data());
+	});
+	pass.colorScales = colorScales.data();
+
+	int from = 0;
+	for (int iteration=0; iteration < settings.iterations; iteration++) {
+		pass.step = 1 << iteration;
+
+		float colorSigma = settings.colorSigma / pass.step;
+		pass.colorScale = 1.0f / (colorSigma * colorSigma);
+
+		float depthSigma = settings.depthSigma * pass.step;
+		pass.depthScale = 1.0f / (depthSigma * depthSigma);
+
+		for (int c=0; c < 3; c++) {
+			pass.color[c] = planes[from][c].data();
+			pass.filtered[c] = planes[1 - from][c].data();
+		}
+
+		scheduler.run(strips, [&](const Tile& strip, int thread) {
+			pass.filterRows(strip.y0, strip.y1);
+		});
+		from = 1 - from;
+	}
+
+	Color* out = image.getPixel(0, firstRow);
+	for (size_t i=0; i < size; i++)
+		out[i] = Color(planes[from][0][i], planes[from][1][i], planes[from][2][i]);
+}
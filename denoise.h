@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+
+#include "vectormath.h"
+#include "color.h"
+#include "image.h"
+
+
+// Cleaning up images rendered with few samples per pixel, e.g. the noise
+// of sphere lights and of picking one of many lights per hit. Next to the
+// colors the renderer writes what the camera ray of every pixel hit first
+// (AOVs, arbitrary output values): the normal, the surface color and the
+// distance. Noise is in the colors only, edges show up in those as well,
+// so the filter blurs across pixels that look alike and not across the
+// ones that don't.
+//
+// The filter is the edge avoiding a-trous wavelet transform (Dammertz et
+// al. 2010): a few passes of a 5x5 B3 spline kernel whose taps are spread
+// twice as far with every pass, so 5 passes span 125 pixels with 25 taps
+// each. Every tap is weighted down by how different its color and
+// features are from the pixel filtered, the color relative to how noisy
+// the pixel's surroundings are.
+
+
+// the first hit of a camera ray, all zero for a miss
+struct SurfaceFeatures {
+	Vector normal;
+	Color albedo; // surfaceColor of the material
+	float depth;  // distance along the ray
+
+	SurfaceFeatures() : normal(0.0f), depth(0.0f) {}
+
+	void add(const SurfaceFeatures& other) {
+		normal += other.normal;
+		albedo += other.albedo;
+		depth += other.depth;
+	}
+
+	void scale(float f) {
+		normal *= f;
+		albedo *= f;
+		depth *= f;
+	}
+};
+
+
+// the features of the pixels of the rows an Image holds, averaged over the
+// samples of a pixel. One plane per channel so the filter can load 4
+// neighbouring pixels at once.
+class AOVBuffers {
+protected:
+	int width, firstRow, rowCount;
+
+public:
+	std::vector<float> normal[3], albedo[3], depth;
+
+	AOVBuffers() : width(0), firstRow(0), rowCount(0) {}
+
+	// room for the rows image holds, all zero
+	void resize(const Image& image);
+
+	int getWidth() const { return width; }
+	int getFirstRow() const { return firstRow; }
+	int getRowCount() const { return rowCount; }
+
+	// pixel (x, y) in frame coordinates, like Image::getPixel()
+	size_t index(int x, int y) const { return x + (size_t)(y - firstRow) * width; }
+
+	void set(int x, int y, const SurfaceFeatures& features);
+	SurfaceFeatures get(int x, int y) const;
+};
+
+
+struct DenoiseSettings {
+	int iterations; // passes, the kernel spans 4 * 2^iterations - 3 pixels
+
+	// differences that weigh a tap down to 1/e. The color one is in
+	// standard deviations of the brightness around the pixel and halved
+	// with every pass since the colors get smoother, the depth one is
+	// relative to the distance of the pixel, per pixel of offset.
+	float colorSigma;
+	float normalSigma;
+	float albedoSigma;
+	float depthSigma;
+
+	DenoiseSettings() {
+		iterations = 5;
+		colorSigma = 6.0f;
+		normalSigma = 0.2f;
+		albedoSigma = 0.1f;
+		depthSigma = 0.02f;
+	}
+};
+
+
+// filters the rows image holds in place, aovs are of the same rows. A band
+// is filtered as if it was the whole frame, so bands filtered one by one
+// don't fit together seamlessly. Runs on threadCount threads (0 = one per
+// hardware thread), 4 pixels at a time with SSE2.
+void denoiseImage(Image& image, const AOVBuffers& aovs,
+	const DenoiseSettings& settings = DenoiseSettings(), int threadCount = 0);
@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "distributed.h"
+#include "sockets.h"
+#include "trace.h"
+
+
+// every message starts with this, results are followed by the pixels
+const uint32_t MESSAGE_MAGIC = 0x44525452; // "RTRD"
+
+enum MessageType : uint32_t {
+	MESSAGE_HELLO,  // worker, once connected
+	MESSAGE_BAND,   // coordinator, render this band
+	MESSAGE_PIXELS, // worker, the band is done
+	MESSAGE_FAILED  // worker, couldn't render the band
+};
+
+struct MessageHeader {
+	uint32_t magic;
+	uint32_t type;
+	int32_t width, height;
+	int32_t firstRow, rowCount;
+	float time;
+};
+
+
+static MessageHeader makeHeader(MessageType type, int width = 0, int height = 0,
+	int firstRow = 0, int rowCount = 0, float time = -1.0f) {
+
+	MessageHeader header;
+	header.magic = MESSAGE_MAGIC;
+	header.type = type;
+	header.width = width;
+	header.height = height;
+	header.firstRow = firstRow;
+	header.rowCount = rowCount;
+	header.time = time;
+	return header;
+}
+
+
+static bool receiveHeader(int socket, MessageHeader& header) {
+	return receiveAll(socket, &header, sizeof(header)) && header.magic == MESSAGE_MAGIC;
+}
+
+
+
+bool runRenderWorker(const std::string& address, const BandRenderer& render, float timeout) {
+
+	int s = -1;
+	auto start = std::chrono::steady_clock::now();
+	while ((s = connectTo(address)) < 0) {
+		// the coordinator might still be loading its scene
+		if (std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count() > timeout) {
+			std::cerr << "couldn't connect to the coordinator at " << address << std::endl;
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	MessageHeader hello = makeHeader(MESSAGE_HELLO);
+	bool ok = sendAll(s, &hello, sizeof(hello));
+
+	std::unique_ptr<Image> band;
+	int bandRows = 0; // band has room for
+	MessageHeader header;
+
+	// until the coordinator is done and hangs up
+	while (ok && receiveHeader(s, header)) {
+		if (header.type != MESSAGE_BAND) {
+			ok = false;
+			break;
+		}
+
+		// setBand() can't grow a band
+		if (!band || band->getWidth() != header.width || band->getHeight() != header.height
+			|| header.rowCount > bandRows) {
+			bandRows = std::max(1, (int)header.rowCount);
+			band.reset(new Image(header.width, header.height, bandRows));
+		}
+		band->setBand(header.firstRow, header.rowCount);
+
+		if (!render(*band, header.time)) {
+			MessageHeader failed = makeHeader(MESSAGE_FAILED);
+			sendAll(s, &failed, sizeof(failed));
+			ok = false;
+			break;
+		}
+
+		MessageHeader result = makeHeader(MESSAGE_PIXELS, header.width, header.height,
+			header.firstRow, header.rowCount, header.time);
+		ok = sendAll(s, &result, sizeof(result))
+			&& sendAll(s, band->getPixel(0, header.firstRow), sizeof(Color) * header.width * header.rowCount);
+	}
+
+	close(s);
+	return ok;
+}
+
+
+
+RenderCoordinator::RenderCoordinator(float timeout)
+	: listener(-1), timeout(timeout), bandSeconds(0.0), bandsDone(0)
+{
+}
+
+
+RenderCoordinator::~RenderCoordinator() {
+
+	// workers take the hang up as the sign to quit
+	for (const Worker& worker: workers)
+		close(worker.socket);
+
+	if (listener >= 0)
+		close(listener);
+	if (!socketPath.empty())
+		unlink(socketPath.c_str());
+}
+
+
+bool RenderCoordinator::listen(const std::string& address) {
+
+	listener = listenOn(address, socketPath);
+	return listener >= 0;
+}
+
+
+void RenderCoordinator::acceptWorker() {
+
+	int s = accept(listener, NULL, NULL);
+	if (s < 0)
+		return;
+
+	// a worker that stops sending in the middle of a band counts as dead
+	setReceiveTimeout(s, timeout);
+
+	MessageHeader hello;
+	if (!receiveHeader(s, hello) || hello.type != MESSAGE_HELLO) {
+		close(s);
+		return;
+	}
+
+	workers.push_back({ s, WORKER_IDLE });
+	std::cout << " worker connected, " << workers.size() << " now" << std::endl;
+}
+
+
+bool RenderCoordinator::sendBand(Worker& worker, int band, int width, int height, float time) {
+
+	Band& b = bands[band];
+	MessageHeader header = makeHeader(MESSAGE_BAND, width, height, b.firstRow, b.rowCount, time);
+	if (!sendAll(worker.socket, &header, sizeof(header)))
+		return false;
+
+	if (b.copies == 0)
+		b.started = std::chrono::steady_clock::now();
+	b.copies++;
+	worker.band = band;
+	return true;
+}
+
+
+bool RenderCoordinator::receiveBand(Worker& worker, Image& image, std::vector<Color>& buffer) {
+
+	MessageHeader header;
+	if (!receiveHeader(worker.socket, header) || header.type != MESSAGE_PIXELS || worker.band == WORKER_IDLE)
+		return false;
+
+	buffer.resize((size_t)header.width * header.rowCount);
+	if (!receiveAll(worker.socket, buffer.data(), sizeof(Color) * buffer.size()))
+		return false;
+
+	// a copy of a band of the last frame
+	if (worker.band == WORKER_STALE) {
+		worker.band = WORKER_IDLE;
+		return true;
+	}
+
+	Band& band = bands[worker.band];
+	if (header.firstRow != band.firstRow || header.rowCount != band.rowCount || header.width != image.getWidth())
+		return false;
+
+	band.copies--;
+	worker.band = WORKER_IDLE;
+
+	// a copy of a band that was done already
+	if (band.done)
+		return true;
+
+	TRACE_SCOPE("copy band");
+	std::copy(buffer.begin(), buffer.end(), image.getPixel(0, band.firstRow));
+	band.done = true;
+	bandSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - band.started).count();
+	bandsDone++;
+	return true;
+}
+
+
+void RenderCoordinator::dropWorker(size_t index) {
+
+	Worker& worker = workers[index];
+	if (worker.band >= 0) {
+		Band& band = bands[worker.band];
+		band.copies--;
+		if (!band.done && band.copies == 0)
+			pending.push_front(worker.band);
+	}
+
+	close(worker.socket);
+	workers.erase(workers.begin() + index);
+	std::cerr << " lost a worker, " << workers.size() << " left" << std::endl;
+}
+
+
+int RenderCoordinator::nextBand() const {
+
+	for (int band: pending)
+		if (!bands[band].done)
+			return band;
+
+	// nothing left in the queue: a copy of the band out for the longest,
+	// if it is taking longer than bands usually take
+	auto now = std::chrono::steady_clock::now();
+	double usual = bandsDone > 0 ? bandSeconds / bandsDone : 0.0;
+	int oldest = -1;
+	for (size_t i=0; i < bands.size(); i++) {
+		const Band& band = bands[i];
+		if (band.done || band.copies != 1)
+			continue;
+		if (std::chrono::duration<double>(now - band.started).count() < usual)
+			continue;
+		if (oldest < 0 || band.started < bands[oldest].started)
+			oldest = i;
+	}
+	return oldest;
+}
+
+
+bool RenderCoordinator::render(Image& image, int bandRows, float time) {
+
+	TRACE_SCOPE("distributed render");
+
+	bandRows = std::max(1, bandRows);
+	bands.clear();
+	pending.clear();
+	bandSeconds = 0.0;
+	bandsDone = 0;
+
+	int y1 = image.getFirstRow() + image.getRowCount();
+	for (int y = image.getFirstRow(); y < y1; y += bandRows) {
+		pending.push_back(bands.size());
+		bands.push_back({ y, std::min(bandRows, y1 - y), 0, false, std::chrono::steady_clock::now() });
+	}
+
+	// workers still busy with a copy from the last frame finish it first
+	for (Worker& worker: workers)
+		if (worker.band != WORKER_IDLE)
+			worker.band = WORKER_STALE;
+
+	std::vector<Color> buffer;
+	auto lastWorker = std::chrono::steady_clock::now();
+
+	while (bandsDone < (int)bands.size()) {
+
+		for (size_t i=0; i < workers.size(); i++) {
+			if (workers[i].band != WORKER_IDLE)
+				continue;
+
+			int band = nextBand();
+			if (band < 0)
+				break;
+
+			auto queued = std::find(pending.begin(), pending.end(), band);
+			if (queued != pending.end())
+				pending.erase(queued);
+
+			if (!sendBand(workers[i], band, image.getWidth(), image.getHeight(), time))
+				dropWorker(i--);
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (!workers.empty())
+			lastWorker = now;
+		else if (std::chrono::duration<float>(now - lastWorker).count() > timeout) {
+			std::cerr << "no workers for " << timeout << " seconds, giving up on the frame" << std::endl;
+			return false;
+		}
+
+		std::vector<pollfd> fds(workers.size() + 1);
+		fds[0] = { listener, POLLIN, 0 };
+		for (size_t i=0; i < workers.size(); i++)
+			fds[i+1] = { workers[i].socket, POLLIN, 0 };
+
+		// wakes up now and then to hand out copies of slow bands
+		if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR)
+			return false;
+
+		// back to front so dropping a worker doesn't move the ones not looked at yet
+		for (size_t i = workers.size(); i-- > 0; ) {
+			if (!(fds[i+1].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			if (!receiveBand(workers[i], image, buffer))
+				dropWorker(i);
+		}
+
+		if (fds[0].revents & POLLIN)
+			acceptWorker();
+	}
+
+	return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+
+// Rendering a frame on other processes, on this machine or others. A
+// coordinator listens on an address and workers connect to it, each with
+// the scene already loaded, i.e. started with the same scene options. The
+// coordinator cuts the frame into bands of rows and hands them out one
+// at a time, every worker sends back the pixels of its band and gets the
+// next. A band renders to the same pixels no matter where (see
+// rayTraceToFile()), so the frame is the same as rendered in one process.
+//
+// Workers may connect or drop out at any time. The band of a worker that
+// dies goes back to the queue, and once the queue is empty idle workers
+// take on copies of bands that are out for longer than bands usually
+// take, so a slow worker doesn't hold up the frame. The first copy back
+// wins.
+//
+// Addresses are "unix:/path/to/socket" or "host:port" for TCP, where the
+// coordinator listens on every interface for "*:port". Pixels are sent
+// as they are in memory, so all machines must have the same byte order.
+
+
+// renders the rows band holds at time (< 0 for a still image), false if
+// it can't, e.g. because band is of another size than the worker's scene
+typedef std::function<bool(Image& band, float time)> BandRenderer;
+
+// connects to the coordinator at address, retrying for timeout seconds,
+// and renders the bands it gets until the coordinator hangs up. False if
+// it couldn't connect or rendering failed.
+bool runRenderWorker(const std::string& address, const BandRenderer& render, float timeout = 10.0f);
+
+
+class RenderCoordinator {
+protected:
+	enum {
+		WORKER_IDLE = -1,
+		WORKER_STALE = -2 // still rendering a copy of a band of the last frame
+	};
+
+	struct Worker {
+		int socket;
+		int band; // being rendered, or one of the above
+	};
+
+	struct Band {
+		int firstRow, rowCount;
+		int copies; // workers rendering it
+		bool done;
+		std::chrono::steady_clock::time_point started; // by the first copy
+	};
+
+	int listener;
+	std::string socketPath; // of a unix socket, removed again at the end
+	float timeout;
+	std::vector<Worker> workers;
+
+	// of the frame being rendered
+	std::vector<Band> bands;
+	std::deque<int> pending;
+	double bandSeconds; // sum over the bands done
+	int bandsDone;
+
+	void acceptWorker();
+	bool sendBand(Worker& worker, int band, int width, int height, float time);
+	bool receiveBand(Worker& worker, Image& image, std::vector<Color>& buffer);
+	void dropWorker(size_t index);
+	int nextBand() const;
+
+public:
+	// gives up on a frame when no worker was connected for timeout seconds
+	RenderCoordinator(float timeout = 60.0f);
+	~RenderCoordinator();
+
+	RenderCoordinator(const RenderCoordinator&) = delete;
+	RenderCoordinator& operator =(const RenderCoordinator&) = delete;
+
+	bool listen(const std::string& address);
+
+	// renders the rows image holds at time in bands of bandRows rows,
+	// false if there were no workers left to finish it
+	bool render(Image& image, int bandRows, float time = -1.0f);
+
+	int getWorkerCount() const { return workers.size(); }
+};
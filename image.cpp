@@ -1,14 +1,22 @@
 #include <algorithm>
 #include <iostream>
+#include <vector>
 
 #include "image.h"
-
-#include <fstream>
+#include "trace.h"
 
 Image::Image(int width, int height)
-	: width(width), height(height)
+	: width(width), height(height), firstRow(0), rowCount(height), bandRows(height)
+{
+	data = new Color[(size_t)width * height];
+}
+
+Image::Image(int width, int height, int bandRows)
+	: width(width), height(height), firstRow(0)
 {
-	data = new Color[width * height];
+	this->bandRows = std::max(1, std::min(bandRows, height));
+	rowCount = this->bandRows;
+	data = new Color[(size_t)width * this->bandRows];
 }
 
 Image::~Image()
@@ -26,33 +34,63 @@ int Image::getHeight() const
 	return height;
 }
 
+int Image::getFirstRow() const
+{
+	return firstRow;
+}
+
+int Image::getRowCount() const
+{
+	return rowCount;
+}
+
+void Image::setBand(int firstRow, int rowCount)
+{
+	this->firstRow = firstRow;
+	this->rowCount = std::min(rowCount, bandRows);
+}
+
 Color* Image::getPixel(int x, int y)
 {
-	return data + (x + y * width);
+	return data + (x + (size_t)(y - firstRow) * width);
 }
 
 
-void Image::saveImagePPM(std::string filename) const {
+void Image::toRGB8(unsigned char* rgb) const
+{
+	convertToRGB8(data, width * rowCount, rgb);
+}
+
+
+void Image::saveImage(std::string filename, int threadCount) const {
+	saveImage(filename, getImageFormat(filename), threadCount);
+}
+
+
+void Image::saveImage(std::string filename, ImageFormat format, int threadCount) const {
 
 	// data[] contains the RGB information with 0 = dark, 1 = full bright
-	// and the float betn 0 to 1 representing in between color
+	// and the float betn 0 to 1 representing in between color. Converted in
+	// one pass and written at once instead of a stream insertion per channel.
 
-	try {
-		std::ofstream ofs(filename, std::ios::binary | std::ios::out);
+	TRACE_SCOPE("save image");
 
-		ofs << "P6\n" << width << " " << height << " 255" << std::endl;
-		for (int i=0; i<height; i++) {
-			for (int j=0; j<width; j++) {
-				ofs << (unsigned char)(std::min(data[i*width + j].r, 1.0f) * 255) 
-					<< (unsigned char)(std::min(data[i*width + j].g, 1.0f) * 255)
-					<< (unsigned char)(std::min(data[i*width + j].b, 1.0f) * 255);
-			}
-		}
+	std::vector<unsigned char> rgb((size_t)width * rowCount * 3);
+	{
+		TRACE_SCOPE("convert to rgb8");
+		toRGB8(rgb.data());
+	}
 
-		ofs.close();
+	std::unique_ptr<ImageStream> stream = openImageStream(filename, format, width, height, threadCount);
+	bool saved = stream && stream->writeRows(rgb.data(), rowCount) && stream->close();
 
-	} catch(...) {
+	if (saved)
+		std::cout << "Rendered image to a " + filename + " file. (SUCCESS)" << std::endl;
+	else
 		std::cerr << "Something really terrible happened so " + filename + " file couldn't be created!!" << std::endl;
-	}
-	std::cout << "Rendered image to a " + filename + " file. (SUCCESS)" << std::endl;
-}
\ No newline at end of file
+}
+
+
+void Image::saveImagePPM(std::string filename) const {
+	saveImage(filename, IMAGE_PPM);
+}
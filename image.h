@@ -3,24 +3,49 @@
 #include <string>
 
 #include "color.h"
+#include "imageFormats.h"
 
+// A width x height frame. For frames too big for memory it can also hold
+// just a band of their rows, [firstRow, firstRow + rowCount), which is moved
+// down the frame with setBand(). Pixels are addressed in frame coordinates
+// either way.
 class Image
 {
 protected:
 	int width, height;
+	int firstRow, rowCount;
+	int bandRows; // rows data has room for
 	Color* data;
 
 public:
 	Image(int width, int height);
 
+	// a band of up to bandRows rows of a width x height frame, at the top
+	Image(int width, int height, int bandRows);
+
 	virtual ~Image();
 	
 	int getWidth() const;
 	int getHeight() const;
 
+	int getFirstRow() const;
+	int getRowCount() const;
+
+	// moves the band to the rows [firstRow, firstRow + rowCount), the pixels
+	// keep their old values until they are rendered again
+	void setBand(int firstRow, int rowCount);
+
 	Color* getPixel(int x, int y);
 
 
+	// 8 bit RGB of the stored rows, 3 bytes per pixel, see convertToRGB8()
+	void toRGB8(unsigned char* rgb) const;
+
+	// for an image holding the whole frame, the format is picked by the
+	// extension when not given
+	void saveImage(std::string filename, int threadCount = 0) const;
+	void saveImage(std::string filename, ImageFormat format, int threadCount = 0) const;
+
 	void saveImagePPM(std::string filename) const;
 
-};
+};
\ No newline at end of file
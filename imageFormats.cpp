@@ -0,0 +1,461 @@
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "imageFormats.h"
+#include "trace.h"
+#include "tileScheduler.h"
+
+
+static_assert(sizeof(Color) == 3 * sizeof(float), "Color has to be 3 packed floats");
+
+
+void convertToRGB8(const Color* pixels, int count, unsigned char* rgb) {
+
+	const float* f = &pixels->r;
+	size_t n = (size_t)count * 3;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+
+	// min() first so NaN ends up as 1 like in the scalar loop
+	auto convert = [&](const float* p) {
+		__m128 c = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(p), one), zero);
+		return _mm_cvttps_epi32(_mm_mul_ps(c, scale));
+	};
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_packs_epi32(convert(f + i), convert(f + i + 4));
+		__m128i b = _mm_packs_epi32(convert(f + i + 8), convert(f + i + 12));
+		_mm_storeu_si128((__m128i*)(rgb + i), _mm_packus_epi16(a, b));
+	}
+#endif
+
+	for (; i < n; i++) {
+		float c = f[i] < 1.0f ? f[i] : 1.0f;
+		c = c > 0.0f ? c : 0.0f;
+		rgb[i] = (unsigned char)(c * 255.0f);
+	}
+}
+
+
+
+static void appendBigEndian(std::vector<unsigned char>& out, unsigned int value) {
+
+	out.push_back(value >> 24);
+	out.push_back(value >> 16);
+	out.push_back(value >> 8);
+	out.push_back(value);
+}
+
+
+static void appendChunk(std::vector<unsigned char>& out, const char* type,
+	const unsigned char* data, size_t size) {
+
+	appendBigEndian(out, size);
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + size);
+	appendBigEndian(out, crc32(0, &out[start], size + 4));
+}
+
+
+// Sub filter (difference to the pixel on the left) for every row. On the
+// renders it compressed better than Up and Paeth and is the cheapest, so
+// trying all filters per row isn't worth it.
+static void filterRow(const unsigned char* row, int rowSize, unsigned char* out) {
+
+	out[0] = 1;
+	for (int i=0; i < 3 && i < rowSize; i++)
+		out[1+i] = row[i];
+	for (int i=3; i < rowSize; i++)
+		out[1+i] = row[i] - row[i-3];
+}
+
+
+// rows of a strip, about 256 KB of raw data so the deflate window has enough
+// to work with and the extra flush per strip costs nothing
+static const int PNG_STRIP_BYTES = 256 * 1024;
+
+
+// The zlib stream of the pixels may be split over several IDAT chunks, so
+// every band becomes one chunk and the stream just continues in the next.
+class PNGEncoder {
+protected:
+	int width, height, threadCount;
+	int rowsDone;
+	uLong adler; // of all filtered rows so far
+
+public:
+	PNGEncoder(int width, int height, int threadCount)
+		: width(width), height(height), threadCount(threadCount), rowsDone(0), adler(1) {}
+
+	// signature and IHDR
+	void begin(std::vector<unsigned char>& out) const;
+
+	// IDAT of the next rows, followed by IEND after the last row
+	void addRows(const unsigned char* rgb, int rows, std::vector<unsigned char>& out);
+};
+
+
+void PNGEncoder::begin(std::vector<unsigned char>& out) const {
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	out.insert(out.end(), signature, signature + 8);
+
+	unsigned char header[13];
+	for (int i=0; i < 4; i++) {
+		header[i] = width >> (24 - 8*i);
+		header[4+i] = height >> (24 - 8*i);
+	}
+	header[8] = 8;  // bits per channel
+	header[9] = 2;  // RGB
+	header[10] = 0; // deflate
+	header[11] = 0; // adaptive filtering
+	header[12] = 0; // not interlaced
+	appendChunk(out, "IHDR", header, sizeof(header));
+}
+
+
+void PNGEncoder::addRows(const unsigned char* rgb, int rows, std::vector<unsigned char>& out) {
+
+	int rowSize = width * 3;
+	int stripRows = std::max(1, PNG_STRIP_BYTES / (rowSize + 1));
+
+	std::vector<Tile> strips;
+	for (int y = 0; y < rows; y += stripRows)
+		strips.push_back({ 0, y, width, std::min(y + stripRows, rows) });
+
+	struct Strip {
+		std::vector<unsigned char> data;
+		uLong adler;
+		size_t rawSize;
+	};
+	std::vector<Strip> compressed(strips.size());
+	bool lastBand = rowsDone + rows == height;
+
+	TileScheduler scheduler(threadCount);
+	scheduler.run(strips, [&](const Tile& tile, int thread) {
+		Strip& strip = compressed[tile.y0 / stripRows];
+		bool last = lastBand && tile.y1 == rows;
+
+		std::vector<unsigned char> filtered((size_t)(tile.y1 - tile.y0) * (rowSize + 1));
+		for (int y = tile.y0; y < tile.y1; y++) {
+			filterRow(rgb + (size_t)y * rowSize, rowSize,
+				&filtered[(size_t)(y - tile.y0) * (rowSize + 1)]);
+		}
+
+		strip.rawSize = filtered.size();
+		strip.adler = adler32(1, filtered.data(), filtered.size());
+
+		// raw deflate, the zlib header and checksum are added around all strips.
+		// The fastest level, higher ones halve the size for twice the time.
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+
+		strip.data.resize(deflateBound(&stream, filtered.size()) + 16);
+		stream.next_in = filtered.data();
+		stream.avail_in = filtered.size();
+		stream.next_out = strip.data.data();
+		stream.avail_out = strip.data.size();
+
+		// a sync flush ends on a byte boundary without marking the last block
+		deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+		strip.data.resize(stream.total_out);
+		deflateEnd(&stream);
+	});
+
+	std::vector<unsigned char> idat;
+	if (rowsDone == 0)
+		idat = { 0x78, 0x01 };
+
+	for (const auto& strip: compressed) {
+		idat.insert(idat.end(), strip.data.begin(), strip.data.end());
+		adler = adler32_combine(adler, strip.adler, strip.rawSize);
+	}
+	rowsDone += rows;
+
+	if (lastBand)
+		appendBigEndian(idat, adler);
+
+	appendChunk(out, "IDAT", idat.data(), idat.size());
+	if (lastBand)
+		appendChunk(out, "IEND", NULL, 0);
+}
+
+
+
+// QOI carries the previous pixel, the index and the current run from one
+// band to the next, so a streamed file is the same as one written at once.
+class QOIEncoder {
+protected:
+	size_t pixelCount, pixelsDone;
+
+	// the alpha of every pixel is 255, so it never needs an RGBA op but is
+	// part of the index hash
+	unsigned int index[64];
+	unsigned char r, g, b;
+	int run;
+
+public:
+	QOIEncoder(int width, int height)
+		: pixelCount((size_t)width * height), pixelsDone(0), index(), r(0), g(0), b(0), run(0) {}
+
+	void begin(std::vector<unsigned char>& out, int width, int height) const;
+
+	// ops of the next pixels, followed by the end marker after the last one
+	void addPixels(const unsigned char* rgb, size_t count, std::vector<unsigned char>& out);
+};
+
+
+void QOIEncoder::begin(std::vector<unsigned char>& out, int width, int height) const {
+
+	out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+	appendBigEndian(out, width);
+	appendBigEndian(out, height);
+	out.push_back(3); // channels
+	out.push_back(0); // sRGB
+}
+
+
+void QOIEncoder::addPixels(const unsigned char* rgb, size_t count, std::vector<unsigned char>& out) {
+
+	out.reserve(out.size() + count * 4 + 8); // worst case
+
+	for (size_t i=0; i < count; i++, pixelsDone++) {
+		const unsigned char* p = rgb + i*3;
+
+		if (p[0] == r && p[1] == g && p[2] == b) {
+			run++;
+			if (run == 62 || pixelsDone == pixelCount - 1) {
+				out.push_back(0xc0 | (run - 1)); // QOI_OP_RUN
+				run = 0;
+			}
+			continue;
+		}
+
+		if (run > 0) {
+			out.push_back(0xc0 | (run - 1));
+			run = 0;
+		}
+
+		unsigned int pixel = p[0] | p[1] << 8 | p[2] << 16 | 0xffu << 24;
+		int slot = (p[0]*3 + p[1]*5 + p[2]*7 + 255*11) % 64;
+
+		if (index[slot] == pixel) {
+			out.push_back(slot); // QOI_OP_INDEX
+		}
+		else {
+			index[slot] = pixel;
+
+			signed char dr = p[0] - r, dg = p[1] - g, db = p[2] - b;
+			signed char drg = dr - dg, dbg = db - dg;
+
+			if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+				out.push_back(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)); // QOI_OP_DIFF
+			}
+			else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+				out.push_back(0x80 | (dg + 32)); // QOI_OP_LUMA
+				out.push_back((drg + 8) << 4 | (dbg + 8));
+			}
+			else {
+				out.insert(out.end(), { 0xfe, p[0], p[1], p[2] }); // QOI_OP_RGB
+			}
+		}
+
+		r = p[0];
+		g = p[1];
+		b = p[2];
+	}
+
+	if (pixelsDone == pixelCount)
+		out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 }); // end marker
+}
+
+
+
+// writes all of data, write() may stop early (signals, huge buffers)
+static bool writeAll(int fd, const unsigned char* data, size_t size) {
+
+	while (size > 0) {
+		ssize_t written = write(fd, data, size);
+		if (written < 0)
+			return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+
+// Encodes every band into a buffer which is reused for the next one and
+// writes it, to the file or appended to memory if that is set. The header
+// goes out with the first band.
+class FileImageStream : public ImageStream {
+protected:
+	int fd;
+	std::vector<unsigned char>* memory;
+	int width, height;
+	int rowsWritten;
+	bool ok;
+	std::vector<unsigned char> encoded;
+
+	// appends the encoding of the rows to encoded
+	virtual void encodeRows(const unsigned char* rgb, int rows) = 0;
+
+public:
+	FileImageStream(int fd, std::vector<unsigned char>* memory, int width, int height)
+		: fd(fd), memory(memory), width(width), height(height), rowsWritten(0), ok(true) {}
+
+	virtual ~FileImageStream() {
+		if (fd >= 0)
+			::close(fd);
+	}
+
+	virtual bool writeRows(const unsigned char* rgb, int rows) {
+
+		if (!ok || (fd < 0 && !memory) || rows <= 0 || rowsWritten + rows > height)
+			return ok = false;
+
+		{
+			TRACE_SCOPE("encode");
+			encodeRows(rgb, rows);
+		}
+		rowsWritten += rows;
+
+		if (memory)
+			memory->insert(memory->end(), encoded.begin(), encoded.end());
+		else {
+			TRACE_SCOPE("write");
+			ok = writeAll(fd, encoded.data(), encoded.size());
+		}
+		encoded.clear();
+		return ok;
+	}
+
+	virtual bool close() {
+
+		if (memory) {
+			memory = NULL;
+			return ok && rowsWritten == height;
+		}
+		if (fd < 0)
+			return false;
+
+		bool complete = ok && rowsWritten == height;
+		complete = ::close(fd) == 0 && complete;
+		fd = -1;
+		return complete;
+	}
+};
+
+
+// a PPM is just the pixels after the header
+class PPMStream : public FileImageStream {
+public:
+	PPMStream(int fd, std::vector<unsigned char>* memory, int width, int height)
+		: FileImageStream(fd, memory, width, height) {
+		std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + " 255\n";
+		encoded.assign(header.begin(), header.end());
+	}
+
+protected:
+	virtual void encodeRows(const unsigned char* rgb, int rows) {
+		encoded.insert(encoded.end(), rgb, rgb + (size_t)rows * width * 3);
+	}
+};
+
+
+class PNGStream : public FileImageStream {
+protected:
+	PNGEncoder encoder;
+
+	virtual void encodeRows(const unsigned char* rgb, int rows) {
+		encoder.addRows(rgb, rows, encoded);
+	}
+
+public:
+	PNGStream(int fd, std::vector<unsigned char>* memory, int width, int height, int threadCount)
+		: FileImageStream(fd, memory, width, height), encoder(width, height, threadCount) {
+		encoder.begin(encoded);
+	}
+};
+
+
+class QOIStream : public FileImageStream {
+protected:
+	QOIEncoder encoder;
+
+	virtual void encodeRows(const unsigned char* rgb, int rows) {
+		encoder.addPixels(rgb, (size_t)rows * width, encoded);
+	}
+
+public:
+	QOIStream(int fd, std::vector<unsigned char>* memory, int width, int height)
+		: FileImageStream(fd, memory, width, height), encoder(width, height) {
+		encoder.begin(encoded, width, height);
+	}
+};
+
+
+
+ImageFormat getImageFormat(const std::string& filename) {
+
+	size_t dot = filename.rfind('.');
+	if (dot == std::string::npos)
+		return IMAGE_PPM;
+
+	std::string extension = filename.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+	if (extension == "png")
+		return IMAGE_PNG;
+	if (extension == "qoi")
+		return IMAGE_QOI;
+	return IMAGE_PPM;
+}
+
+
+// to the file if memory is NULL
+static std::unique_ptr<ImageStream> makeImageStream(int fd, std::vector<unsigned char>* memory,
+	ImageFormat format, int width, int height, int threadCount) {
+
+	switch (format) {
+	case IMAGE_PNG:
+		return std::unique_ptr<ImageStream>(new PNGStream(fd, memory, width, height, threadCount));
+	case IMAGE_QOI:
+		return std::unique_ptr<ImageStream>(new QOIStream(fd, memory, width, height));
+	case IMAGE_PPM:
+	default:
+		return std::unique_ptr<ImageStream>(new PPMStream(fd, memory, width, height));
+	}
+}
+
+
+std::unique_ptr<ImageStream> openImageStream(const std::string& filename, ImageFormat format,
+	int width, int height, int threadCount) {
+
+	int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return NULL;
+
+	return makeImageStream(fd, NULL, format, width, height, threadCount);
+}
+
+
+std::unique_ptr<ImageStream> openImageStream(std::vector<unsigned char>& memory, ImageFormat format,
+	int width, int height, int threadCount) {
+
+	return makeImageStream(-1, &memory, format, width, height, threadCount);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "color.h"
+
+
+// Encoders behind Image::saveImage(). They work on 8 bit RGB, 3 bytes per
+// pixel row by row, which convertToRGB8() makes from the float framebuffer.
+
+
+// clamps every channel to [0, 1] and scales it to 0..255 (rounding down,
+// like the old stream based PPM writer), 16 channels at a time with SSE2
+void convertToRGB8(const Color* pixels, int count, unsigned char* rgb);
+
+
+enum ImageFormat {
+	IMAGE_PPM, // binary P6, uncompressed
+	IMAGE_PNG, // strips filtered and deflated on several threads
+	IMAGE_QOI  // qoiformat.org, lossless in one fast pass, but sequential
+};
+
+// by the extension: .png, .qoi and PPM for anything else
+ImageFormat getImageFormat(const std::string& filename);
+
+
+// Writes an image a band of rows at a time, top to bottom, so a frame never
+// has to be in memory as a whole. Every band is encoded into one buffer and
+// written with a single write().
+//
+// PNG bands are split into strips which are filtered and deflated on
+// threadCount threads (0 = one per hardware thread). Every strip is a
+// separate deflate stream ending on a byte boundary, so they just get
+// concatenated into one zlib stream with the checksums combined.
+class ImageStream {
+public:
+	virtual ~ImageStream() {}
+
+	// appends the next rows, false once something couldn't be written
+	virtual bool writeRows(const unsigned char* rgb, int rows) = 0;
+
+	// false if the file is incomplete, i.e. not all rows were written or a
+	// write failed
+	virtual bool close() = 0;
+};
+
+// NULL if the file can't be created
+std::unique_ptr<ImageStream> openImageStream(const std::string& filename, ImageFormat format,
+	int width, int height, int threadCount = 0);
+
+// the same into memory, the encoded file is appended to memory, e.g. to
+// send it over a socket
+std::unique_ptr<ImageStream> openImageStream(std::vector<unsigned char>& memory, ImageFormat format,
+	int width, int height, int threadCount = 0);
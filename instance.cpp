@@ -0,0 +1,124 @@
+#include "instance.h"
+
+
+MeshInstance::MeshInstance(TriangleMesh* mesh, const Transform& toWorld)
+	: mesh(mesh)
+{
+	setTransform(toWorld);
+}
+
+
+MeshInstance::~MeshInstance()
+{
+}
+
+
+void MeshInstance::setTransform(const Transform& toWorld) {
+
+	this->toWorld = toWorld;
+	toObject = toWorld.inverse();
+
+	// box around the transformed corners of the mesh's box
+	BoundingBox meshBox;
+	bounds = BoundingBox();
+	if (mesh->getBoundingBox(meshBox)) {
+		for (int corner=0; corner < 8; corner++) {
+			Point p((corner & 1) ? meshBox.max.x : meshBox.min.x,
+				(corner & 2) ? meshBox.max.y : meshBox.min.y,
+				(corner & 4) ? meshBox.max.z : meshBox.min.z);
+			bounds.extend(toWorld.applyPoint(p));
+		}
+	}
+}
+
+
+Intersection MeshInstance::toObjectIntersection(const Intersection& intersection) const {
+
+	Intersection local(toObjectRay(intersection.ray));
+	local.t = intersection.t;
+	local.pShape = mesh;
+	local.primitiveId = intersection.primitiveId;
+	local.color = intersection.color;
+	return local;
+}
+
+
+bool MeshInstance::intersect(Intersection& intersection) {
+
+	if (bounds.isEmpty())
+		return false;
+
+	Intersection local(toObjectRay(intersection.ray));
+	local.t = intersection.t;
+
+	if (!mesh->intersect(local))
+		return false;
+
+	intersection.t = local.t;
+	intersection.pShape = this;
+	intersection.primitiveId = local.primitiveId;
+	intersection.color = local.color;
+	return true;
+}
+
+
+bool MeshInstance::doesIntersect(const Ray& ray) {
+	return !bounds.isEmpty() && mesh->doesIntersect(toObjectRay(ray));
+}
+
+
+bool MeshInstance::occluded(const Ray& ray, float maxDistance, const MaterialProperty*& lens) {
+	return !bounds.isEmpty() && mesh->occluded(toObjectRay(ray), maxDistance, lens);
+}
+
+
+void MeshInstance::intersectPacket(RayPacket& packet) {
+
+	if (bounds.isEmpty())
+		return;
+
+	// inactive lanes repeat an active ray, so transforming every lane
+	// keeps the packet bounds as tight as they were
+	Ray rays[PACKET_SIZE];
+	for (int i=0; i < PACKET_SIZE; i++) {
+		Point origin(packet.ox[i], packet.oy[i], packet.oz[i]);
+		Vector direction(packet.dx[i], packet.dy[i], packet.dz[i]);
+		rays[i] = Ray(toObject.applyPoint(origin), toObject.applyVector(direction));
+	}
+
+	RayPacket local(rays, PACKET_SIZE);
+	local.activeMask = packet.activeMask;
+	for (int i=0; i < PACKET_SIZE; i++)
+		local.t[i] = packet.t[i];
+
+	mesh->intersectPacket(local);
+
+	for (int i=0; i < PACKET_SIZE; i++) {
+		if (local.pShape[i] != NULL) {
+			packet.t[i] = local.t[i];
+			packet.record(1 << i, this, local.color[i], local.primitiveId[i]);
+		}
+	}
+}
+
+
+Vector MeshInstance::getNormalVector(const Intersection& intersection) {
+
+	Vector normal = mesh->getNormalVector(toObjectIntersection(intersection));
+	return toObject.applyTransposed(normal).normalized();
+}
+
+
+const MaterialProperty& MeshInstance::getMaterialProperty() {
+	return mesh->getMaterialProperty();
+}
+
+
+bool MeshInstance::getBoundingBox(BoundingBox& box) {
+
+	if (bounds.isEmpty())
+		return false;
+
+	box = bounds;
+	return true;
+}
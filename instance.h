@@ -0,0 +1,52 @@
+#pragma once
+
+#include "vectormath.h"
+#include "transform.h"
+#include "ray.h"
+#include "shape.h"
+#include "triangleMesh.h"
+
+
+// A placement of a shared TriangleMesh through an affine transform. Rays
+// are moved into the mesh's space and traced through its own BVH (the
+// bottom level), while the scene's BVH over the instance boxes is the top
+// level. So a field of 1000 copies of a 10000 triangle mesh stores the
+// triangles once plus 1000 of these records.
+//
+// The ray direction is transformed but not normalized, so t means the same
+// in both spaces and hits compare directly with those of other shapes.
+// Hits point at the instance with primitiveId the triangle of the mesh.
+class MeshInstance : public Shape
+{
+protected:
+	TriangleMesh* mesh; // shared, has to outlive the instance
+	Transform toWorld, toObject;
+	BoundingBox bounds; // world space
+
+	Ray toObjectRay(const Ray& ray) const {
+		return Ray(toObject.applyPoint(ray.origin), toObject.applyVector(ray.direction), ray.tMax);
+	}
+
+	// the hit as the mesh would have reported it
+	Intersection toObjectIntersection(const Intersection& intersection) const;
+
+public:
+	MeshInstance(TriangleMesh* mesh, const Transform& toWorld);
+
+	virtual ~MeshInstance();
+
+	TriangleMesh* getMesh() const { return mesh; }
+	const Transform& getTransform() const { return toWorld; }
+
+	// moves the instance, the scene needs an update() afterwards
+	void setTransform(const Transform& toWorld);
+
+	virtual Vector getNormalVector(const Point& pHit) { return Vector(); } // needs the triangle
+	virtual Vector getNormalVector(const Intersection& intersection);
+	virtual const MaterialProperty& getMaterialProperty();
+	virtual bool intersect(Intersection& intersection);
+	virtual bool doesIntersect(const Ray& ray);
+	virtual bool occluded(const Ray& ray, float maxDistance, const MaterialProperty*& lens);
+	virtual bool getBoundingBox(BoundingBox& box);
+	virtual void intersectPacket(RayPacket& packet);
+};
@@ -0,0 +1,118 @@
+#include <algorithm>
+
+#include "lightSet.h"
+#include "trace.h"
+
+
+int LightSet::addLight(const LightSource& light) {
+
+	lights.push_back(light);
+	return lights.size() - 1;
+}
+
+
+void LightSet::build() {
+
+	TRACE_SCOPE("light tree build");
+
+	nodes.clear();
+	if (lights.empty())
+		return;
+
+	nodes.reserve(2 * lights.size() - 1);
+
+	std::vector<int> order(lights.size());
+	for (size_t i=0; i < order.size(); i++)
+		order[i] = i;
+
+	buildNode(order, 0, order.size());
+}
+
+
+int LightSet::buildNode(std::vector<int>& order, int start, int end) {
+
+	int nodeIndex = nodes.size();
+	nodes.push_back(LightNode());
+
+	LightNode node;
+	node.power = 0.0f;
+	BoundingBox centroids;
+	for (int i = start; i < end; i++) {
+		const LightSource& light = lights[order[i]];
+		node.box.extend(light.getBoundingBox());
+		node.power += light.getPower();
+		centroids.extend(light.position);
+	}
+
+	if (end - start == 1) {
+		node.offset = order[start];
+		node.leaf = true;
+		nodes[nodeIndex] = node;
+		return nodeIndex;
+	}
+
+	// median split along the axis the lights spread the most, so nearby
+	// lights end up in one subtree
+	int axis = centroids.largestAxis();
+	int mid = (start + end) / 2;
+	std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+		[&](int a, int b) { return lights[a].position[axis] < lights[b].position[axis]; });
+
+	buildNode(order, start, mid); // left child lands at nodeIndex + 1
+	node.offset = buildNode(order, mid, end);
+	node.leaf = false;
+	nodes[nodeIndex] = node;
+	return nodeIndex;
+}
+
+
+float LightSet::getImportance(const LightNode& node, const Point& point) const {
+
+	if (node.leaf) {
+		const LightSource& light = lights[node.offset];
+		float distance2 = std::max((light.position - point).length2(), light.radius * light.radius);
+		return light.brightness * light.getFalloff(point) / std::max(distance2, 1e-6f);
+	}
+
+	// as if all of it came from the centre, but not closer than half the
+	// box so a point within a cluster doesn't overrate it
+	Vector extent = node.box.max - node.box.min;
+	float distance2 = std::max((node.box.centroid() - point).length2(), 0.25f * extent.length2());
+	return node.power / std::max(distance2, 1e-6f);
+}
+
+
+bool LightSet::pickLight(const Point& point, float u, int& light, float& probability) const {
+
+	if (nodes.empty())
+		return false;
+
+	probability = 1.0f;
+	int nodeIndex = 0;
+
+	while (!nodes[nodeIndex].leaf) {
+		int left = nodeIndex + 1, right = nodes[nodeIndex].offset;
+		float leftImportance = getImportance(nodes[left], point);
+		float rightImportance = getImportance(nodes[right], point);
+
+		float total = leftImportance + rightImportance;
+		if (total <= 0.0f)
+			return false;
+
+		// u is stretched to [0, 1) again for the next decision
+		float pLeft = leftImportance / total;
+		if (u < pLeft) {
+			u = std::min(u / pLeft, 0.99999994f);
+			probability *= pLeft;
+			nodeIndex = left;
+		}
+		else {
+			u = std::min((u - pLeft) / (1.0f - pLeft), 0.99999994f);
+			probability *= 1.0f - pLeft;
+			nodeIndex = right;
+		}
+	}
+
+	light = nodes[nodeIndex].offset;
+	return probability > 0.0f;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include "lightSource.h"
+
+
+// node of the light tree, stored depth first like BVHNode: the left child
+// of an interior node is the node right after it
+struct LightNode {
+	BoundingBox box;
+	float power;  // of all lights below
+	int offset;   // leaf: index of the light, interior: right child
+	bool leaf;
+};
+
+
+// The lights of a scene. Shading a hit with every light costs a shadow ray
+// per light, so instead every hit picks one light at random and divides
+// what it gets by the probability of the pick, which is right on average.
+// To keep the noise down the probability follows how much each light
+// likely gives: a tree over the lights is walked from the root, picking
+// either child by its power over the distance squared to its box. Lights
+// far away or dim share a subtree and are rarely visited, nearby bright
+// ones are picked most of the time, and a pick costs a walk down the tree
+// no matter how many lights there are.
+class LightSet {
+protected:
+	std::vector<LightSource> lights;
+	std::vector<LightNode> nodes;
+
+	int buildNode(std::vector<int>& order, int start, int end);
+
+	// estimate of the light arriving at point from below node
+	float getImportance(const LightNode& node, const Point& point) const;
+
+public:
+	LightSet() {}
+
+	// returns the index of the light, call build() after adding
+	int addLight(const LightSource& light);
+
+	// the tree over the lights added so far
+	void build();
+
+	int getLightCount() const { return lights.size(); }
+	const LightSource& getLight(int index) const { return lights[index]; }
+
+	// the light for a hit at point picked by u in [0, 1), and the
+	// probability it was picked with. False if no light reaches point.
+	bool pickLight(const Point& point, float u, int& light, float& probability) const;
+};
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <cmath>
+
+#include "lightSource.h"
+
+
+float LightSource::getFalloff(const Point& point) const {
+
+	if (type != LIGHT_SPOT)
+		return 1.0f;
+
+	float cosAngle = dot((point - position).normalized(), direction);
+	if (cosAngle <= cosOuter)
+		return 0.0f;
+	if (cosAngle >= cosInner)
+		return 1.0f;
+
+	// smooth from the outer to the inner edge
+	float t = (cosAngle - cosOuter) / (cosInner - cosOuter);
+	return t * t * (3.0f - 2.0f * t);
+}
+
+
+Point LightSource::samplePosition(const Point& point, const Vector2& u) const {
+
+	if (type != LIGHT_SPHERE)
+		return position;
+
+	Vector w = point - position;
+	float distance = w.length();
+	if (distance <= radius)
+		return position;
+	w /= distance;
+
+	// uniform on the half of the sphere around w
+	Vector helper = std::fabs(w.x) > 0.9f ? Vector(0.0f, 1.0f, 0.0f) : Vector(1.0f, 0.0f, 0.0f);
+	Vector uAxis = cross(helper, w).normalized();
+	Vector vAxis = cross(w, uAxis);
+
+	float z = u.u;
+	float r = std::sqrt(std::max(0.0f, 1.0f - z*z));
+	float phi = 2.0f * M_PI * u.v;
+
+	return position + radius * (r * std::cos(phi) * uAxis + r * std::sin(phi) * vAxis + z * w);
+}
+
+
+float LightSource::getPower() const {
+
+	if (type == LIGHT_SPOT)
+		return brightness * 0.5f * (1.0f - cosOuter);
+	return brightness;
+}
+
+
+BoundingBox LightSource::getBoundingBox() const {
+	return BoundingBox(position - Vector(radius), position + Vector(radius));
+}
+
+
+LightSource makeSpotLight(const Vector& position, const Vector& direction,
+	float innerAngle, float outerAngle, float brightness) {
+
+	LightSource light(position, brightness);
+	light.type = LIGHT_SPOT;
+	light.direction = direction.normalized();
+	light.cosOuter = std::cos(outerAngle);
+	light.cosInner = std::max(std::cos(innerAngle), light.cosOuter + 1e-4f);
+	return light;
+}
+
+
+LightSource makeSphereLight(const Vector& position, float radius, float brightness) {
+
+	LightSource light(position, brightness);
+	light.type = LIGHT_SPHERE;
+	light.radius = radius;
+	return light;
+}
@@ -1,11 +1,54 @@
 #pragma once
 
+#include "vectormath.h"
+#include "boundingBox.h"
+
+
+enum LightType {
+	LIGHT_POINT,
+	LIGHT_SPOT,  // a point light that only shines into a cone
+	LIGHT_SPHERE // a glowing ball, its shadows have soft edges
+};
+
+
+// brightness is what arrives at distance 1, it falls off with the square
+// of the distance from there
 struct LightSource {
+	LightType type;
 	Vector position;
 	float brightness;
 
+	Vector direction;         // spot: axis of the cone
+	float cosInner, cosOuter; // spot: full brightness up to the inner angle, none past the outer
+	float radius;             // sphere
+
 	LightSource(const Vector& position, const float brightness = 60.0f) {
+		this->type = LIGHT_POINT;
 		this->position = position;
 		this->brightness = brightness;
-	} 
-};
\ No newline at end of file
+		this->cosInner = -1.0f;
+		this->cosOuter = -1.0f;
+		this->radius = 0.0f;
+	}
+
+	// share of the brightness that reaches point, only spot lights have
+	// anything but 1
+	float getFalloff(const Point& point) const;
+
+	// where the light seen from point comes from. For sphere lights a point
+	// on the half facing it, picked by u in [0, 1)^2, so that averaging
+	// many gives the soft shadow.
+	Point samplePosition(const Point& point, const Vector2& u) const;
+
+	// brightness times the share of all directions it shines into
+	float getPower() const;
+
+	BoundingBox getBoundingBox() const;
+};
+
+
+// angles in radians from the axis
+LightSource makeSpotLight(const Vector& position, const Vector& direction,
+	float innerAngle, float outerAngle, float brightness = 60.0f);
+
+LightSource makeSphereLight(const Vector& position, float radius, float brightness = 60.0f);
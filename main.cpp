@@ -1,25 +1,145 @@
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "image.h"
 #include "camera.h"
 #include "shape.h"
-#include "lightSource.h"
+#include "scene.h"
+#include "triangleMesh.h"
+#include "instance.h"
+#include "animation.h"
+#include "meshCache.h"
+#include "lightSet.h"
+#include "renderSettings.h"
 #include "rayTrace.h"
+#include "wavefront.h"
+#include "streamRender.h"
+#include "distributed.h"
+#include "renderServer.h"
 #include "rayCast.h"
+#include "denoise.h"
+#include "stats.h"
+#include "trace.h"
 #include "objParser.h"
 
 
 int main(int argc, char** argv)
 {
+	// usage: main [output.ppm|.png|.qoi] [--threads N] [--tile-size N] [--no-packets] [--wavefront]
+	//                    [--samples N] [--min-samples N] [--aa-threshold T]
+	//                    [--max-depth N] [--min-throughput T] [--russian-roulette] [--denoise]
+	//                    [--sampler random|stratified|sobol|bluenoise]
+	//                    [--width N] [--height N] [--band-rows N]
+	//                    [--frames N] [--fps F]
+	//                    [--stats stats.json] [--heatmap]   (make STATS=1 builds only)
+	//                    [--trace trace.json]
+	//                    [--coordinator ADDRESS [--spawn-workers N]] [--worker ADDRESS]
+	//                    [--serve ADDRESS] [--request ADDRESS "key=value ..."]
+	// ADDRESS is unix:/path or host:port, see sockets.h. Workers are
+	// started with the same scene options as the coordinator. A server
+	// keeps the scene loaded and renders requests, see renderServer.h.
+	std::string filename = "renderedImage.ppm";
+	RenderSettings settings;
 	int width = 1920;
 	int height = 1080;
+	int frames = 0; // a still by default
+	float fps = 24.0f;
+	std::string statsFilename;
+	bool heatmap = false; // per tile render time, next to the image
+	std::string coordinatorAddress, workerAddress;
+	std::string serverAddress, requestAddress, requestLine;
+	int spawnWorkers = 0;
+
+	for (int i=1; i < argc; i++) {
+		if (!strcmp(argv[i], "--threads") && i+1 < argc)
+			settings.threadCount = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--tile-size") && i+1 < argc)
+			settings.tileSize = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--no-packets"))
+			settings.usePackets = false;
+		else if (!strcmp(argv[i], "--wavefront"))
+			settings.wavefront = true;
+		else if (!strcmp(argv[i], "--samples") && i+1 < argc)
+			settings.maxSamples = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--min-samples") && i+1 < argc)
+			settings.minSamples = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--aa-threshold") && i+1 < argc)
+			settings.aaThreshold = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--max-depth") && i+1 < argc)
+			settings.maxDepth = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--min-throughput") && i+1 < argc)
+			settings.minThroughput = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--russian-roulette"))
+			settings.russianRoulette = true;
+		else if (!strcmp(argv[i], "--denoise"))
+			settings.denoise = true;
+		else if (!strcmp(argv[i], "--width") && i+1 < argc)
+			width = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--height") && i+1 < argc)
+			height = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--band-rows") && i+1 < argc)
+			settings.bandRows = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--frames") && i+1 < argc)
+			frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--fps") && i+1 < argc)
+			fps = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--stats") && i+1 < argc)
+			statsFilename = argv[++i];
+		else if (!strcmp(argv[i], "--heatmap"))
+			heatmap = true;
+		else if (!strcmp(argv[i], "--coordinator") && i+1 < argc)
+			coordinatorAddress = argv[++i];
+		else if (!strcmp(argv[i], "--worker") && i+1 < argc)
+			workerAddress = argv[++i];
+		else if (!strcmp(argv[i], "--spawn-workers") && i+1 < argc)
+			spawnWorkers = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--serve") && i+1 < argc)
+			serverAddress = argv[++i];
+		else if (!strcmp(argv[i], "--request") && i+2 < argc) {
+			requestAddress = argv[++i];
+			requestLine = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--trace") && i+1 < argc)
+			startTrace(argv[++i]); // written at exit
+		else if (!strcmp(argv[i], "--sampler") && i+1 < argc) {
+			if (!parseSamplerType(argv[++i], settings.sampler)) {
+				std::cerr << "unknown sampler " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else
+			filename = argv[i];
+	}
+
+	// a client of a render server doesn't need a scene
+	if (!requestAddress.empty())
+		return sendRenderRequest(requestAddress, requestLine, filename) ? 0 : 1;
+
+	// the wavefront tracer shoots one ray through the corner of every pixel
+	if (settings.wavefront && settings.maxSamples > 1) {
+		std::cerr << "--wavefront traces one sample per pixel, ignoring it for --samples "
+			<< settings.maxSamples << std::endl;
+		settings.wavefront = false;
+	}
+
+	// the filter needs the whole frame and the features of its first hits
+	if (settings.denoise && (settings.wavefront || settings.bandRows > 0
+		|| !coordinatorAddress.empty() || !workerAddress.empty())) {
+		std::cerr << "--denoise only works with the recursive tracer on whole frames, ignoring it" << std::endl;
+		settings.denoise = false;
+	}
 
-	Image image(width, height);
 	PerspectiveCamera camera(Point(-5.0f, 1.0f, 0.0f),
 		Vector(0.0f, 1.0f, 0.0f), Vector(), M_PI / 4,
 		(float)width / (float)height);
 
-	ShapeSet scene;
+	// the shapes below are copied into the scene's flat arrays by addShape()
+	Scene scene;
 
 	Plane floor(Point(0.0f, 0.0f, 0.0f), Vector(),
 		Color(0.4f, 1.0f, 0.4f), 0.1f);
@@ -27,11 +147,11 @@ int main(int argc, char** argv)
 
 	Sphere sphere(Point(0.0f, 1.0f, 0.0f), 1.0f,
 		Color(0.9f, 0.3f, 0.2f), 0.7f);
-	scene.addShape(&sphere);
+	int sphereId = scene.addShape(&sphere);
 
 	Sphere sphere3(Point(7.0f, 7.0f, -5.0f), 2.0f,
 		Color(0.6f, 0.8f, 0.9f), 1.0f);
-	scene.addShape(&sphere3);
+	int sphere3Id = scene.addShape(&sphere3);
 
 	Sphere sphere2(Point(5.0f, 4.0f, 0.0f), 3.0f,
 		Color(0.2f, 0.1f, 1.0f), 0.8f);
@@ -75,24 +195,246 @@ int main(int argc, char** argv)
 	// scene.addShape(&triangle);
 
 
-	// ObjParser objParser("pumpkin.obj");
+	// parsed once, later runs map pumpkin.obj.cache
+	// std::unique_ptr<TriangleMesh> pumpkin = MeshCache::load("pumpkin.obj",
+	// 	Color(0.9f, 0.2f, 0.1f));
+	// scene.addShape(pumpkin.get());
 
-	// // for (auto& it: objParser.triangles)
-	// // 	scene.addShape(&it);
+	// a field of pumpkins sharing the mesh above, each one only a transform
+	// std::vector<std::unique_ptr<MeshInstance>> field;
+	// for (int i=0; i < 1000; i++) {
+	// 	Transform placement = Transform::translation(Vector(3.0f + (i % 32) * 1.5f, 0.0f, (i / 32 - 15) * 1.5f))
+	// 		* Transform::rotation(Vector(0.0f, 1.0f, 0.0f), i * 0.7f)
+	// 		* Transform::rotation(Vector(1.0f, 0.0f, 0.0f), -M_PI / 2)
+	// 		* Transform::scaling(0.015f) * Transform::translation(Vector(0.0f, 0.0f, 110.0f));
+	// 	field.emplace_back(new MeshInstance(pumpkin.get(), placement));
+	// 	scene.addShape(field.back().get());
+	// }
 
-	// for (int i=0; i<100; i++)
-	// 	scene.addShape(&objParser.triangles[i]);
 
+	scene.build();
 
-    LightSource lightSource(Vector(5.0f, 15.0f, 4.0f), 270.0f);
+	LightSet lights;
+	lights.addLight(LightSource(Vector(5.0f, 15.0f, 4.0f), 270.0f));
+	// lights.addLight(makeSpotLight(Vector(-3.0f, 6.0f, 3.0f), Vector(1.0f, -1.0f, -0.5f),
+	// 	M_PI / 12, M_PI / 8, 120.0f));
+	// lights.addLight(makeSphereLight(Vector(-4.0f, 5.0f, -4.0f), 0.5f, 60.0f));
+	lights.build();
 
 
-	rayTrace(image, &camera, &scene, lightSource);
-    // rayCast(image, &camera, &scene, lightSource);
+	// with --frames the red sphere rolls away from the camera and the sky
+	// blue one drops to the floor
+	Animation animation;
 
-	std::string filename = "renderedImage.ppm";
-	if (argc > 1)
-		filename = argv[1];
+	AnimationTrack roll;
+	roll.addKeyframe(Keyframe(0.0f));
+	roll.addKeyframe(Keyframe(2.0f, Vector(4.0f, 0.0f, -3.0f), Vector(0.0f, 0.0f, -5.0f)));
+	animation.animatePrimitives(scene, sphereId, 1, roll);
+
+	AnimationTrack drop;
+	drop.addKeyframe(Keyframe(0.5f));
+	drop.addKeyframe(Keyframe(1.5f, Vector(0.0f, -5.0f, 0.0f)));
+	animation.animatePrimitives(scene, sphere3Id, 1, drop);
+
+
+	// a frame in memory with the tracer picked, with --denoise filtered
+	// afterwards. Returns the number of camera samples.
+	auto renderImage = [&](Image& image, Camera* view, const RenderSettings& viewSettings) -> long long {
+		if (viewSettings.wavefront) {
+			rayTraceWavefront(image, view, &scene, lights, viewSettings);
+			return (long long)image.getWidth() * image.getRowCount();
+		}
+		if (!viewSettings.denoise)
+			return rayTrace(image, view, &scene, lights, viewSettings);
+
+		AOVBuffers aovs;
+		long long samples = rayTrace(image, view, &scene, lights, viewSettings, &aovs);
+		denoiseImage(image, aovs, DenoiseSettings(), viewSettings.threadCount);
+		return samples;
+	};
+
+
+	// a worker renders the bands a coordinator sends until it is done
+	if (!workerAddress.empty()) {
+		float sceneTime = -1.0f; // the scene is at rest
+
+		bool ok = runRenderWorker(workerAddress, [&](Image& band, float time) {
+			if (band.getWidth() != width || band.getHeight() != height) {
+				std::cerr << "the coordinator renders " << band.getWidth() << "x" << band.getHeight()
+					<< ", start the worker with the same --width and --height" << std::endl;
+				return false;
+			}
+			time = std::max(time, -1.0f); // any negative time is the rest pose
+			if (time != sceneTime) {
+				animation.apply(scene, time);
+				sceneTime = time;
+			}
+
+			if (settings.wavefront)
+				rayTraceWavefront(band, &camera, &scene, lights, settings);
+			else
+				rayTrace(band, &camera, &scene, lights, settings);
+			return true;
+		});
+		return ok ? 0 : 1;
+	}
+
+	if (!serverAddress.empty()) {
+		RenderRequest defaults;
+		defaults.width = width;
+		defaults.height = height;
+		defaults.cameraPosition = Point(-5.0f, 1.0f, 0.0f);
+		defaults.cameraTarget = Point(0.0f, 1.0f, 0.0f);
+		defaults.cameraUp = Vector();
+		defaults.fov = 45.0f;
+		defaults.samples = settings.maxSamples;
+		defaults.time = -1.0f;
+		defaults.format = IMAGE_PNG;
+
+		float sceneTime = -1.0f;
+
+		bool ok = runRenderServer(serverAddress, defaults, [&](const RenderRequest& request, Image& image) {
+			// a request without a time is the scene at rest, whatever the
+			// requests before it asked for
+			float time = std::max(request.time, -1.0f);
+			if (time != sceneTime) {
+				animation.apply(scene, time);
+				sceneTime = time;
+			}
+
+			PerspectiveCamera view(request.cameraPosition, request.cameraTarget, request.cameraUp,
+				request.fov * M_PI / 180, (float)request.width / (float)request.height);
+			RenderSettings viewSettings = settings;
+			viewSettings.maxSamples = request.samples;
+			if (viewSettings.maxSamples > 1)
+				viewSettings.wavefront = false; // see --wavefront above
+
+			renderImage(image, &view, viewSettings);
+			return true;
+		}, settings.threadCount);
+		return ok ? 0 : 1;
+	}
+
+	std::unique_ptr<RenderCoordinator> coordinator;
+	std::vector<pid_t> localWorkers;
+	float frameTime = -1.0f; // of the frame being rendered, < 0 for a still
+
+	if (!coordinatorAddress.empty()) {
+		coordinator.reset(new RenderCoordinator());
+		if (!coordinator->listen(coordinatorAddress))
+			return 1;
+
+		// the same command line, as workers, without the outputs
+		std::vector<std::string> workerArgs;
+		for (int i=0; i < argc; i++) {
+			if (!strcmp(argv[i], "--coordinator") || !strcmp(argv[i], "--spawn-workers")
+				|| !strcmp(argv[i], "--trace") || !strcmp(argv[i], "--stats"))
+				i++;
+			else if (strcmp(argv[i], "--heatmap"))
+				workerArgs.push_back(argv[i]);
+		}
+		workerArgs.push_back("--worker");
+		workerArgs.push_back(coordinatorAddress);
+
+		std::vector<char*> workerArgv;
+		for (std::string& arg: workerArgs)
+			workerArgv.push_back(&arg[0]);
+		workerArgv.push_back(NULL);
+
+		for (int i=0; i < spawnWorkers; i++) {
+			pid_t pid = fork();
+			if (pid == 0) {
+				execv("/proc/self/exe", workerArgv.data());
+				_exit(127);
+			}
+			if (pid > 0)
+				localWorkers.push_back(pid);
+		}
+	}
+
+
+	auto render = [&](const std::string& filename) -> bool {
+		TRACE_SCOPE("frame");
+		long long samples = (long long)width * height;
+
+		if (coordinator) {
+			Image image(width, height);
+			if (!coordinator->render(image, settings.tileSize, frameTime))
+				return false;
+			image.saveImage(filename, settings.threadCount);
+			return true;
+		}
+
+		if (settings.bandRows > 0) {
+			// only a band of the image is ever in memory
+			samples = rayTraceToFile(filename, width, height, &camera, &scene, lights, settings);
+			if (samples < 0) {
+				std::cerr << "Something really terrible happened so " + filename + " file couldn't be created!!" << std::endl;
+				return false;
+			}
+			std::cout << "Rendered image to a " + filename + " file. (SUCCESS)" << std::endl;
+		}
+		else {
+			Image image(width, height);
+
+			samples = renderImage(image, &camera, settings);
+		    // rayCast(image, &camera, &scene, lights);
+
+			image.saveImage(filename, settings.threadCount);
+		}
+
+		if (settings.maxSamples > 1 && !settings.wavefront)
+			std::cout << " adaptive anti-aliasing: " << (double)samples / ((double)width * height)
+				<< " samples per pixel on average (" << std::max(1, std::min(settings.minSamples, settings.maxSamples))
+				<< " to " << settings.maxSamples << ")" << std::endl;
+		return true;
+	};
+
+	// frames and the heatmap are named by inserting before the extension,
+	// out.png -> out_0001.png
+	size_t dot = filename.find_last_of('.');
+	size_t slash = filename.find_last_of('/');
+	if (dot == std::string::npos || (slash != std::string::npos && slash > dot))
+		dot = filename.size();
+
+	if (frames <= 0 && !render(filename))
+		return 1;
+
+	for (int frame=0; frame < frames; frame++) {
+		frameTime = frame / fps;
+		if (animation.apply(scene, frameTime))
+			std::cout << " frame " << frame + 1 << ": BVH rebuilt" << std::endl;
+
+		char number[16];
+		snprintf(number, sizeof(number), "_%04d", frame + 1);
+		if (!render(filename.substr(0, dot) + number + filename.substr(dot)))
+			return 1;
+	}
+
+	// hanging up tells the workers to quit
+	coordinator.reset();
+	for (pid_t pid: localWorkers)
+		waitpid(pid, NULL, 0);
+
+	if (!statsFilename.empty() || heatmap) {
+#ifdef RENDER_STATS
+		// of all frames together
+		if (!statsFilename.empty()) {
+			if (writeStatsReport(statsFilename))
+				std::cout << "Wrote render statistics to " + statsFilename << std::endl;
+			else
+				std::cerr << "couldn't write " + statsFilename << std::endl;
+		}
 
-	image.saveImagePPM(filename);
-}
\ No newline at end of file
+		if (heatmap) {
+			std::string heatmapFilename = filename.substr(0, dot) + "_heatmap" + filename.substr(dot);
+			if (writeTileHeatmap(heatmapFilename, width, height))
+				std::cout << "Wrote the tile heatmap to " + heatmapFilename << std::endl;
+			else
+				std::cerr << "couldn't write " + heatmapFilename << std::endl;
+		}
+#else
+		std::cerr << "statistics aren't compiled in, rebuild with make clean && make STATS=1" << std::endl;
+#endif
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+
+// read only memory mapping of a whole file, unmapped again on destruction
+class MappedFile {
+protected:
+	const char* data;
+	size_t size;
+
+public:
+	MappedFile(const std::string& fileName);
+
+	virtual ~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator =(const MappedFile&) = delete;
+
+	bool isOpen() const;
+	const char* getData() const;
+	size_t getSize() const;
+};
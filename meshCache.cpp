@@ -0,0 +1,268 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <sys/stat.h>
+
+#include "meshCache.h"
+#include "objParser.h"
+#include "trace.h"
+
+
+const char MESH_CACHE_MAGIC[8] = { 'R', 'T', 'M', 'E', 'S', 'H', 0, 0 };
+const uint32_t MESH_CACHE_VERSION = 1;
+const uint32_t MESH_CACHE_BYTE_ORDER = 0x01020304; // reads back differently on the other endianness
+const uint64_t MESH_CACHE_ALIGNMENT = 64;
+
+
+// the file starts with this header, followed by the sections at the given
+// offsets, each aligned to MESH_CACHE_ALIGNMENT:
+//   vertices     vx[], vy[], vz[]             3 * vertexCount floats
+//   indices      3 per triangle               3 * triangleCount ints
+//   edges        e1x[] ... e2z[]              6 * triangleCount floats
+//   nodes        BVHNode[]                    nodeCount nodes
+//   bvh indices  triangle ids in leaf order   triangleCount ints
+struct MeshCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t nodeSize; // sizeof(BVHNode) of the writer
+	uint32_t vertexCount, triangleCount, nodeCount;
+
+	// identifies the OBJ file the cache was made from
+	uint64_t sourceSize;
+	int64_t sourceModifiedSeconds, sourceModifiedNanoseconds;
+
+	uint64_t vertexOffset, indexOffset, edgeOffset, nodeOffset, bvhIndexOffset;
+	uint64_t fileSize;
+};
+
+
+static uint64_t align(uint64_t offset) {
+	return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+}
+
+
+// fills in everything that follows from the counts
+static void layoutSections(MeshCacheHeader& header) {
+
+	header.vertexOffset = align(sizeof(MeshCacheHeader));
+	header.indexOffset = align(header.vertexOffset + 3 * sizeof(float) * (uint64_t)header.vertexCount);
+	header.edgeOffset = align(header.indexOffset + 3 * sizeof(int) * (uint64_t)header.triangleCount);
+	header.nodeOffset = align(header.edgeOffset + 6 * sizeof(float) * (uint64_t)header.triangleCount);
+	header.bvhIndexOffset = align(header.nodeOffset + sizeof(BVHNode) * (uint64_t)header.nodeCount);
+	header.fileSize = header.bvhIndexOffset + sizeof(int) * (uint64_t)header.triangleCount;
+}
+
+
+static bool stampSource(const std::string& objFileName, MeshCacheHeader& header) {
+
+	struct stat info;
+	if (stat(objFileName.c_str(), &info) != 0)
+		return false;
+
+	header.sourceSize = info.st_size;
+	header.sourceModifiedSeconds = info.st_mtim.tv_sec;
+	header.sourceModifiedNanoseconds = info.st_mtim.tv_nsec;
+	return true;
+}
+
+
+// the mesh and the traversal use the indices in the file as they are, so
+// a damaged cache has to be caught here rather than crash the renderer:
+// every index in range and the nodes a depth first tree no deeper than the
+// traversal stacks allow
+static bool checkSections(const MeshCacheHeader& header, const int* indices,
+	const BVHNode* nodes, const int* bvhIndices) {
+
+	int nv = header.vertexCount, nt = header.triangleCount, nodeCount = header.nodeCount;
+	if (nv < 0 || nt < 0 || nodeCount < 0)
+		return false;
+
+	for (int i=0; i < 3 * nt; i++)
+		if (indices[i] < 0 || indices[i] >= nv)
+			return false;
+
+	for (int i=0; i < nt; i++)
+		if (bvhIndices[i] < 0 || bvhIndices[i] >= nt)
+			return false;
+
+	// children come after their parent, so the depth of a node is known
+	// by the time it is reached. -1 is a node no parent points at.
+	std::vector<int> depth(nodeCount, -1);
+	if (nodeCount > 0)
+		depth[0] = 0;
+
+	for (int i=0; i < nodeCount; i++) {
+		const BVHNode& node = nodes[i];
+		if (depth[i] < 0 || depth[i] > BVH_MAX_DEPTH || node.count < 0)
+			return false;
+
+		if (node.isLeaf()) {
+			if (node.offset < 0 || node.offset > nt - node.count)
+				return false;
+			continue;
+		}
+
+		int left = i + 1, right = node.offset;
+		if (right <= left || right >= nodeCount || depth[left] >= 0 || depth[right] >= 0)
+			return false;
+		depth[left] = depth[right] = depth[i] + 1;
+	}
+
+	return true;
+}
+
+
+std::string MeshCache::getCacheFileName(const std::string& objFileName) {
+	return objFileName + ".cache";
+}
+
+
+bool MeshCache::write(const std::string& cacheFileName, const TriangleMesh& mesh,
+	const std::string& objFileName) {
+
+	const MeshArrays& arrays = mesh.getArrays();
+	const BVH& bvh = mesh.getBVH();
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.byteOrder = MESH_CACHE_BYTE_ORDER;
+	header.nodeSize = sizeof(BVHNode);
+	header.vertexCount = arrays.vertexCount;
+	header.triangleCount = arrays.triangleCount;
+	header.nodeCount = bvh.getNodeCount();
+
+	if (!stampSource(objFileName, header))
+		return false;
+
+	layoutSections(header);
+
+	// write next to the real name and rename at the end, so a reader
+	// never maps a half written file
+	std::string tempFileName = cacheFileName + ".tmp";
+	std::ofstream ofs(tempFileName, std::ios::binary | std::ios::out);
+	if (!ofs)
+		return false;
+
+	auto section = [&](uint64_t offset, const void* data, uint64_t size) {
+		static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+		ofs.write(zeros, offset - (uint64_t)ofs.tellp());
+		ofs.write((const char*)data, size);
+	};
+
+	int nv = arrays.vertexCount, nt = arrays.triangleCount;
+
+	ofs.write((const char*)&header, sizeof(header));
+	section(header.vertexOffset, arrays.vx, nv * sizeof(float));
+	section(ofs.tellp(), arrays.vy, nv * sizeof(float));
+	section(ofs.tellp(), arrays.vz, nv * sizeof(float));
+	section(header.indexOffset, arrays.indices, 3 * nt * sizeof(int));
+	section(header.edgeOffset, arrays.e1x, nt * sizeof(float));
+	const float* edges[5] = { arrays.e1y, arrays.e1z, arrays.e2x, arrays.e2y, arrays.e2z };
+	for (const float* edge: edges)
+		section(ofs.tellp(), edge, nt * sizeof(float));
+	section(header.nodeOffset, bvh.getNodes(), bvh.getNodeCount() * sizeof(BVHNode));
+	section(header.bvhIndexOffset, bvh.getIndices(), bvh.getPrimitiveCount() * sizeof(int));
+
+	ofs.close();
+	if (!ofs || std::rename(tempFileName.c_str(), cacheFileName.c_str()) != 0) {
+		std::remove(tempFileName.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+
+bool MeshCache::map(const std::string& cacheFileName, const std::string& objFileName,
+	TriangleMesh& mesh) {
+
+	std::shared_ptr<MappedFile> file(new MappedFile(cacheFileName));
+	if (!file->isOpen() || file->getSize() < sizeof(MeshCacheHeader))
+		return false;
+
+	const char* data = file->getData();
+	MeshCacheHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != MESH_CACHE_VERSION ||
+		header.byteOrder != MESH_CACHE_BYTE_ORDER ||
+		header.nodeSize != sizeof(BVHNode))
+		return false;
+
+	// stale if the OBJ file changed since
+	MeshCacheHeader source;
+	if (!stampSource(objFileName, source) ||
+		source.sourceSize != header.sourceSize ||
+		source.sourceModifiedSeconds != header.sourceModifiedSeconds ||
+		source.sourceModifiedNanoseconds != header.sourceModifiedNanoseconds)
+		return false;
+
+	// the offsets have to be the ones the counts imply, this also
+	// catches truncated files
+	MeshCacheHeader expected = header;
+	layoutSections(expected);
+	if (memcmp(&expected, &header, sizeof(header)) != 0 || header.fileSize != file->getSize())
+		return false;
+
+	if (!checkSections(header, (const int*)(data + header.indexOffset),
+		(const BVHNode*)(data + header.nodeOffset), (const int*)(data + header.bvhIndexOffset)))
+		return false;
+
+	int nv = header.vertexCount, nt = header.triangleCount;
+	const float* vertices = (const float*)(data + header.vertexOffset);
+	const float* edges = (const float*)(data + header.edgeOffset);
+
+	MeshArrays& arrays = mesh.arrays;
+	arrays.vertexCount = nv;
+	arrays.triangleCount = nt;
+	arrays.vx = vertices; arrays.vy = vertices + nv; arrays.vz = vertices + 2*nv;
+	arrays.indices = (const int*)(data + header.indexOffset);
+	arrays.e1x = edges; arrays.e1y = edges + nt; arrays.e1z = edges + 2*nt;
+	arrays.e2x = edges + 3*nt; arrays.e2y = edges + 4*nt; arrays.e2z = edges + 5*nt;
+
+	mesh.bvh.attach((const BVHNode*)(data + header.nodeOffset), header.nodeCount,
+		(const int*)(data + header.bvhIndexOffset), nt);
+	mesh.mapping = file;
+
+	return true;
+}
+
+
+std::unique_ptr<TriangleMesh> MeshCache::load(const std::string& objFileName,
+	const Color& surfaceColor,
+	const float reflection,
+	const float transparency,
+	const float refractiveIndex,
+	const Color& emissionColor) {
+
+	TRACE_SCOPE("mesh cache load");
+	auto start = std::chrono::steady_clock::now();
+	std::string cacheFileName = getCacheFileName(objFileName);
+
+	std::unique_ptr<TriangleMesh> mesh(new TriangleMesh(surfaceColor, reflection,
+		transparency, refractiveIndex, emissionColor));
+
+	if (map(cacheFileName, objFileName, *mesh)) {
+		double ms = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0;
+		std::cout << cacheFileName << " mapped in " << ms << " ms ("
+			<< mesh->getTriangleCount() << " triangles)" << std::endl;
+		return mesh;
+	}
+
+	ObjParser parser(objFileName);
+	mesh.reset(new TriangleMesh(parser.vertices, parser.indices, surfaceColor,
+		reflection, transparency, refractiveIndex, emissionColor));
+
+	if (!write(cacheFileName, *mesh, objFileName))
+		std::cerr << cacheFileName << " couldn't be written, the mesh will be parsed again next time" << std::endl;
+
+	return mesh;
+}
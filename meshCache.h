@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "color.h"
+#include "triangleMesh.h"
+
+
+// Binary cache of a parsed OBJ mesh together with its BVH, stored next to
+// the source as <file>.cache. A valid cache is memory mapped and the mesh
+// uses the arrays inside the mapping directly: no parsing, no copying and
+// no BVH build. The cache remembers size and modification time of the OBJ
+// file and is rebuilt when either changed or the format version moved on.
+class MeshCache {
+public:
+	static std::unique_ptr<TriangleMesh> load(const std::string& objFileName,
+		const Color& surfaceColor = Color(1.0f, 1.0f, 1.0f),
+		const float reflection = 0.0f,
+		const float transparency = 0.0f,
+		const float refractiveIndex = 1.0f,
+		const Color& emissionColor = Color(0.0f));
+
+	static std::string getCacheFileName(const std::string& objFileName);
+
+	// writes the mesh and its BVH in the cache format, false on IO errors
+	static bool write(const std::string& cacheFileName, const TriangleMesh& mesh,
+		const std::string& objFileName);
+
+	// points mesh at the arrays in a mapped cache file, false if the file
+	// isn't a valid cache of objFileName, down to every index in it
+	static bool map(const std::string& cacheFileName, const std::string& objFileName,
+		TriangleMesh& mesh);
+};
@@ -1,48 +1,228 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
 #include "objParser.h"
+#include "mappedFile.h"
+#include "trace.h"
 
 
-ObjParser::ObjParser(std::string fileName) {
+// files smaller than this are not worth splitting up
+const size_t OBJ_MIN_CHUNK_SIZE = 1 << 20;
 
-	std::ifstream objFile(fileName);
-	std::stringstream ss;
-	std::string line;
 
-	if (objFile.is_open()) {
-		while (getline(objFile, line)) {
-			
-			ss.clear();
-			ss << line;
+// what one thread found in its part of the file. Relative face indices
+// can only be resolved once the number of vertices in all the earlier
+// chunks is known, until then they count from this chunk's first vertex.
+struct ObjChunk {
+	std::vector<Point> vertices;
+	std::vector<int> indices;
+	std::vector<int> chunkRelative; // positions in indices that still need the chunk offset
+	std::vector<int> faceTriangles; // how many triangles of indices each face was fanned into
+	int skippedFaces = 0;
+};
 
-			char c;
-			ss >> c;
-			if (c == 'v') {
-				float coords[3];
-				for (int i=0; i<3; i++) {
-					ss >> coords[i];
-				}
-				vertices.push_back(Point(coords[0], coords[1], coords[2]));
-			}
 
-			else {
-				int a, b, c;
-				ss >> a >> b >> c;
-				a--; b--; c--; 
+static const char* skipSpaces(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	return p;
+}
+
+static const char* skipToken(const char* p, const char* end) {
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+		p++;
+	return p;
+}
+
+static const char* parseFloat(const char* p, const char* end, float& value) {
+	p = skipSpaces(p, end);
+	if (p < end && *p == '+')
+		p++; // from_chars doesn't take a plus sign
+
+	auto result = std::from_chars(p, end, value);
+	if (result.ec != std::errc())
+		value = 0.0f;
+	return result.ptr;
+}
+
+
+// one "f" line, indices are 1 based or negative (counted back from the
+// last vertex read so far). A line that doesn't parse adds nothing.
+static bool parseFace(const char* p, const char* end, ObjChunk& chunk) {
+
+	size_t indexCount = chunk.indices.size();
+	size_t relativeCount = chunk.chunkRelative.size();
+	auto rollBack = [&]() {
+		chunk.indices.resize(indexCount);
+		chunk.chunkRelative.resize(relativeCount);
+		return false;
+	};
+
+	int corners[3];
+	bool cornerRelative[3];
+	int cornerCount = 0;
+
+	while (true) {
+		p = skipSpaces(p, end);
+		if (p >= end || *p == '\r' || *p == '\n' || *p == '#')
+			break;
+
+		int index;
+		auto result = std::from_chars(p, end, index);
+		if (result.ec != std::errc() || index == 0)
+			return rollBack();
 
-				Color surfaceColor(0.9f, 0.2f, 0.1f);
+		bool relative = index < 0;
+		index = relative ? (int)chunk.vertices.size() + index : index - 1;
 
-				Point verts[] = { vertices[a], vertices[b], vertices[c]};
+		// ignore the texture coordinate and normal of the corner
+		p = skipToken(result.ptr, end);
 
-				triangles.push_back(Triangle( verts, surfaceColor));
+		// fan the polygon out from its first corner
+		if (cornerCount < 3) {
+			corners[cornerCount] = index;
+			cornerRelative[cornerCount] = relative;
+			cornerCount++;
+		}
+		else {
+			corners[1] = corners[2];
+			cornerRelative[1] = cornerRelative[2];
+			corners[2] = index;
+			cornerRelative[2] = relative;
+		}
+
+		if (cornerCount == 3) {
+			for (int i=0; i < 3; i++) {
+				if (cornerRelative[i])
+					chunk.chunkRelative.push_back(chunk.indices.size());
+				chunk.indices.push_back(corners[i]);
 			}
+		}
+	}
+
+	if (cornerCount < 3)
+		return false;
+
+	chunk.faceTriangles.push_back((chunk.indices.size() - indexCount) / 3);
+	return true;
+}
+
+
+static void parseChunk(const char* p, const char* end, ObjChunk& chunk) {
+
+	TRACE_SCOPE("obj parse chunk");
+
+	while (p < end) {
+		const char* lineEnd = std::find(p, end, '\n');
+		p = skipSpaces(p, lineEnd);
+
+		if (lineEnd - p > 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+			float coords[3];
+			const char* q = p + 2;
+			for (int i=0; i < 3; i++)
+				q = parseFloat(q, lineEnd, coords[i]);
+			chunk.vertices.push_back(Point(coords[0], coords[1], coords[2]));
+		}
+		else if (lineEnd - p > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+			if (!parseFace(p + 2, lineEnd, chunk))
+				chunk.skippedFaces++;
+		}
+		// comments, vt, vn, groups, materials... are of no use to us
+
+		p = lineEnd + 1;
+	}
+}
+
+
+ObjParser::ObjParser(std::string fileName, int threadCount) {
+
+	TRACE_SCOPE("obj parse");
+	auto start = std::chrono::steady_clock::now();
+
+	MappedFile file(fileName);
+	if (!file.isOpen()) {
+		std::cerr << fileName << " couldn't be opened!!" << std::endl;
+		return;
+	}
+
+	const char* data = file.getData();
+	size_t size = file.getSize();
+
+	if (threadCount <= 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::max(1, std::min<int>(threadCount, size / OBJ_MIN_CHUNK_SIZE));
+
+	// cut the file into roughly equal parts at line breaks
+	std::vector<const char*> bounds(threadCount + 1);
+	bounds[0] = data;
+	bounds[threadCount] = data + size;
+	for (int i=1; i < threadCount; i++) {
+		const char* p = std::max(bounds[i-1], data + size * i / threadCount);
+		p = std::find(p, data + size, '\n');
+		bounds[i] = (p < data + size) ? p + 1 : p;
+	}
+
+	std::vector<ObjChunk> chunks(threadCount);
+	std::vector<std::thread> workers;
+	for (int i=1; i < threadCount; i++)
+		workers.push_back(std::thread(parseChunk, bounds[i], bounds[i+1], std::ref(chunks[i])));
+	parseChunk(bounds[0], bounds[1], chunks[0]);
+	for (auto& worker: workers)
+		worker.join();
+
+	// stitch the chunks together
+	TRACE_SCOPE("obj merge chunks");
+	size_t vertexCount = 0, indexCount = 0;
+	int skippedFaces = 0;
+	for (const auto& chunk: chunks) {
+		vertexCount += chunk.vertices.size();
+		indexCount += chunk.indices.size();
+		skippedFaces += chunk.skippedFaces;
+	}
+
+	vertices.reserve(vertexCount);
+	indices.reserve(indexCount);
+
+	for (auto& chunk: chunks) {
+		int offset = vertices.size();
+		for (int i: chunk.chunkRelative)
+			chunk.indices[i] += offset;
+
+		vertices.insert(vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+	}
+
+	// checked once all vertices are in, so which faces are kept doesn't
+	// depend on where the chunks were cut. A polygon is kept or skipped as
+	// a whole.
+	for (const auto& chunk: chunks) {
+		auto face = chunk.indices.begin();
+		for (int triangles: chunk.faceTriangles) {
+			auto faceEnd = face + triangles * 3;
 
+			// a face may use any vertex of the file
+			bool valid = std::all_of(face, faceEnd, [&](int index) {
+				return index >= 0 && index < (int)vertexCount;
+			});
+			if (valid)
+				indices.insert(indices.end(), face, faceEnd);
+			else
+				skippedFaces++;
 
+			face = faceEnd;
 		}
-		objFile.close();
 	}
 
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
 	std::cout << fileName << " parsed successfully. " << std::endl;
 	std::cout << "vertices : " << vertices.size() << std::endl;
-	std::cout << "triangles : " << triangles.size() << std::endl;
+	std::cout << "triangles : " << indices.size() / 3 << std::endl;
+	if (skippedFaces > 0)
+		std::cout << "skipped faces : " << skippedFaces << std::endl;
+	std::cout << "parsed " << size / 1.0e6 << " MB in " << seconds * 1000.0 << " ms ("
+		<< size / 1.0e6 / seconds << " MB/s, " << threadCount << " threads)" << std::endl;
 	std::cout << "-------------------------------------------------" << std::endl;
-}
\ No newline at end of file
+}
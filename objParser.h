@@ -1,24 +1,23 @@
 #pragma once
 
 
-#include <iostream>
-#include <fstream>
-#include <sstream>
+#include <string>
 #include <vector>
 
 #include "vectormath.h"
-#include "shape.h"
 
 
 
+// Wavefront OBJ loader. Reads vertex positions and faces, faces may use the
+// v, v/vt, v//vn and v/vt/vn forms, negative (relative) indices and any
+// number of corners (fanned into triangles). Everything else is skipped.
+// The file is memory mapped and parsed in chunks on several threads.
 class ObjParser {
 
 public:
 	std::vector<Point> vertices;
-	std::vector<Triangle> triangles;
+	std::vector<int> indices; // 3 per triangle, see TriangleMesh
 
-
-	ObjParser(std::string fileName);
+	// threadCount <= 0 picks one thread per hardware thread
+	ObjParser(std::string fileName, int threadCount = 0);
 };
-
-
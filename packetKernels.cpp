@@ -0,0 +1,256 @@
+#include "packetKernels.h"
+#include "simd.h"
+
+// Compiled once per instruction set (see Makefile and packetKernels.h),
+// PACKET_KERNELS_ISA names the namespace of the build. Keep this file free
+// of calls to the inline helpers of the other headers: an out of line copy
+// built with AVX could end up being the one the rest of the program links
+// against.
+
+namespace PACKET_KERNELS_ISA {
+
+
+static float minOf(float a, float b) { return a < b ? a : b; }
+static float maxOf(float a, float b) { return a > b ? a : b; }
+
+
+// the kernels below spell out the scalar code operation by operation, so
+// that a packet hit is bit for bit the hit Shape::intersect would find
+
+static vbool8 activeLanes(const RayPacket& packet) {
+	// inactive lanes carry a negative t which no candidate can undercut
+	return vfloat8::load(packet.t) > vfloat8(-RAY_T_MAX);
+}
+
+
+int intersectSpherePacket(RayPacket& packet, const Point& center, float radius) {
+
+	vfloat8 ox = vfloat8::load(packet.ox) - vfloat8(center.x);
+	vfloat8 oy = vfloat8::load(packet.oy) - vfloat8(center.y);
+	vfloat8 oz = vfloat8::load(packet.oz) - vfloat8(center.z);
+	vfloat8 dx = vfloat8::load(packet.dx);
+	vfloat8 dy = vfloat8::load(packet.dy);
+	vfloat8 dz = vfloat8::load(packet.dz);
+	vfloat8 tCurrent = vfloat8::load(packet.t);
+
+	vfloat8 a = dx*dx + dy*dy + dz*dz;
+	vfloat8 b = vfloat8(2.0f) * (ox*dx + oy*dy + oz*dz);
+	vfloat8 c = (ox*ox + oy*oy + oz*oz) - vfloat8(radius*radius);
+
+	vfloat8 discriminant = b*b - vfloat8(4.0f)*a*c;
+	vbool8 valid = activeLanes(packet) & (discriminant >= vfloat8(0.0f))
+		& (vfloat8(2.0f)*a != vfloat8(0.0f));
+
+	vfloat8 root = vsqrt(vmax(discriminant, vfloat8(0.0f)));
+	vfloat8 t0 = (-b - root) / vfloat8(2.0f) * a;
+	vfloat8 t1 = (-b + root) / vfloat8(2.0f) * a;
+
+	vbool8 hit0 = (t0 > vfloat8(RAY_T_MIN)) & (t0 < tCurrent);
+	vbool8 hit1 = (t1 > vfloat8(RAY_T_MIN)) & (t1 < tCurrent);
+
+	vfloat8 tHit = select(hit0, t0, t1);
+	vbool8 hit = valid & (hit0 | hit1);
+
+	select(hit, tHit, tCurrent).store(packet.t);
+	return movemask(hit);
+}
+
+
+int intersectPlanePacket(RayPacket& packet, const Point& position, const Vector& normal) {
+
+	vfloat8 nx(normal.x), ny(normal.y), nz(normal.z);
+	vfloat8 tCurrent = vfloat8::load(packet.t);
+
+	vfloat8 dDotN = vfloat8::load(packet.dx)*nx + vfloat8::load(packet.dy)*ny
+		+ vfloat8::load(packet.dz)*nz;
+
+	vfloat8 px = vfloat8(position.x) - vfloat8::load(packet.ox);
+	vfloat8 py = vfloat8(position.y) - vfloat8::load(packet.oy);
+	vfloat8 pz = vfloat8(position.z) - vfloat8::load(packet.oz);
+	vfloat8 t = (px*nx + py*ny + pz*nz) / dDotN;
+
+	vbool8 hit = activeLanes(packet) & (dDotN != vfloat8(0.0f))
+		& (t > vfloat8(RAY_T_MIN)) & (t < tCurrent);
+
+	select(hit, t, tCurrent).store(packet.t);
+	return movemask(hit);
+}
+
+
+// dot(cross(to - from, Q - from), normal) >= 0 for every lane
+static vbool8 insideEdge(const Point& from, const Point& to, const Vector& normal,
+	vfloat8 qx, vfloat8 qy, vfloat8 qz) {
+
+	float ex = to.x - from.x, ey = to.y - from.y, ez = to.z - from.z;
+
+	vfloat8 vx = qx - vfloat8(from.x);
+	vfloat8 vy = qy - vfloat8(from.y);
+	vfloat8 vz = qz - vfloat8(from.z);
+
+	vfloat8 cx = vfloat8(ey)*vz - vfloat8(ez)*vy;
+	vfloat8 cy = vfloat8(ez)*vx - vfloat8(ex)*vz;
+	vfloat8 cz = vfloat8(ex)*vy - vfloat8(ey)*vx;
+
+	return cx*vfloat8(normal.x) + cy*vfloat8(normal.y) + cz*vfloat8(normal.z) >= vfloat8(0.0f);
+}
+
+
+int intersectTrianglePacket(RayPacket& packet, const Point& A, const Point& B,
+	const Point& C, const Point& position, const Vector& normal) {
+
+	vfloat8 nx(normal.x), ny(normal.y), nz(normal.z);
+	vfloat8 ox = vfloat8::load(packet.ox);
+	vfloat8 oy = vfloat8::load(packet.oy);
+	vfloat8 oz = vfloat8::load(packet.oz);
+	vfloat8 dx = vfloat8::load(packet.dx);
+	vfloat8 dy = vfloat8::load(packet.dy);
+	vfloat8 dz = vfloat8::load(packet.dz);
+	vfloat8 tCurrent = vfloat8::load(packet.t);
+
+	// plane of the triangle first
+	vfloat8 dDotN = dx*nx + dy*ny + dz*nz;
+	vfloat8 t = ((vfloat8(position.x) - ox)*nx + (vfloat8(position.y) - oy)*ny
+		+ (vfloat8(position.z) - oz)*nz) / dDotN;
+
+	vbool8 hit = activeLanes(packet) & (dDotN != vfloat8(0.0f))
+		& (t > vfloat8(RAY_T_MIN)) & (t < tCurrent);
+
+	if (movemask(hit) == 0)
+		return 0;
+
+	// then whether the hit point lies left of all three edges
+	vfloat8 qx = ox + dx*t;
+	vfloat8 qy = oy + dy*t;
+	vfloat8 qz = oz + dz*t;
+
+	hit = hit & insideEdge(B, C, normal, qx, qy, qz)
+		& insideEdge(C, A, normal, qx, qy, qz)
+		& insideEdge(A, B, normal, qx, qy, qz);
+
+	select(hit, t, tCurrent).store(packet.t);
+	return movemask(hit);
+}
+
+
+int intersectMeshTrianglePacket(RayPacket& packet, const float v0[3],
+	const float e1[3], const float e2[3]) {
+
+	vfloat8 dx = vfloat8::load(packet.dx);
+	vfloat8 dy = vfloat8::load(packet.dy);
+	vfloat8 dz = vfloat8::load(packet.dz);
+	vfloat8 e1x(e1[0]), e1y(e1[1]), e1z(e1[2]);
+	vfloat8 e2x(e2[0]), e2y(e2[1]), e2z(e2[2]);
+	vfloat8 tCurrent = vfloat8::load(packet.t);
+
+	// p = cross(d, e2), det = dot(e1, p)
+	vfloat8 px = dy*e2z - dz*e2y;
+	vfloat8 py = dz*e2x - dx*e2z;
+	vfloat8 pz = dx*e2y - dy*e2x;
+	vfloat8 det = e1x*px + e1y*py + e1z*pz;
+	vfloat8 invDet = vfloat8(1.0f) / det;
+
+	vfloat8 sx = vfloat8::load(packet.ox) - vfloat8(v0[0]);
+	vfloat8 sy = vfloat8::load(packet.oy) - vfloat8(v0[1]);
+	vfloat8 sz = vfloat8::load(packet.oz) - vfloat8(v0[2]);
+	vfloat8 u = (sx*px + sy*py + sz*pz) * invDet;
+
+	// q = cross(s, e1)
+	vfloat8 qx = sy*e1z - sz*e1y;
+	vfloat8 qy = sz*e1x - sx*e1z;
+	vfloat8 qz = sx*e1y - sy*e1x;
+	vfloat8 v = (dx*qx + dy*qy + dz*qz) * invDet;
+	vfloat8 t = (e2x*qx + e2y*qy + e2z*qz) * invDet;
+
+	vbool8 hit = activeLanes(packet) & (det != vfloat8(0.0f))
+		& (u >= vfloat8(0.0f)) & (v >= vfloat8(0.0f)) & (u + v <= vfloat8(1.0f))
+		& (t > vfloat8(RAY_T_MIN)) & (t < tCurrent);
+
+	select(hit, t, tCurrent).store(packet.t);
+	return movemask(hit);
+}
+
+
+bool intersectBoxPacket(const RayPacket& packet, const float boxMin[3],
+	const float boxMax[3], float& tEntry) {
+
+	float tFarthest = packet.t[0];
+	for (int i=1; i < PACKET_SIZE; i++)
+		tFarthest = maxOf(tFarthest, packet.t[i]);
+
+	if (packet.coherent) {
+		// interval arithmetic over the whole packet: the earliest any ray can
+		// be inside all three slabs against the latest any ray can still be
+		float tNearLow = -RAY_T_MAX, tFarHigh = RAY_T_MAX;
+
+		for (int axis=0; axis < 3; axis++) {
+			bool positive = packet.invDirectionMin[axis] >= 0.0f;
+			float nearPlane = positive ? boxMin[axis] : boxMax[axis];
+			float farPlane = positive ? boxMax[axis] : boxMin[axis];
+
+			// (plane - origin) * invDirection is monotonic in each interval
+			float nearCandidates[4] = {
+				(nearPlane - packet.originMin[axis]) * packet.invDirectionMin[axis],
+				(nearPlane - packet.originMin[axis]) * packet.invDirectionMax[axis],
+				(nearPlane - packet.originMax[axis]) * packet.invDirectionMin[axis],
+				(nearPlane - packet.originMax[axis]) * packet.invDirectionMax[axis] };
+			float farCandidates[4] = {
+				(farPlane - packet.originMin[axis]) * packet.invDirectionMin[axis],
+				(farPlane - packet.originMin[axis]) * packet.invDirectionMax[axis],
+				(farPlane - packet.originMax[axis]) * packet.invDirectionMin[axis],
+				(farPlane - packet.originMax[axis]) * packet.invDirectionMax[axis] };
+
+			tNearLow = maxOf(tNearLow, minOf(minOf(nearCandidates[0], nearCandidates[1]),
+				minOf(nearCandidates[2], nearCandidates[3])));
+			tFarHigh = minOf(tFarHigh, maxOf(maxOf(farCandidates[0], farCandidates[1]),
+				maxOf(farCandidates[2], farCandidates[3])));
+		}
+
+		if (tNearLow > tFarHigh || tFarHigh <= 0.0f || tNearLow >= tFarthest)
+			return false;
+	}
+
+	// per lane slab test, the same as BVHNode::intersect
+	vfloat8 t0 = (vfloat8(boxMin[0]) - vfloat8::load(packet.ox)) * vfloat8::load(packet.invDx);
+	vfloat8 t1 = (vfloat8(boxMax[0]) - vfloat8::load(packet.ox)) * vfloat8::load(packet.invDx);
+	vfloat8 tNear = vmin(t0, t1);
+	vfloat8 tFar = vmax(t0, t1);
+
+	t0 = (vfloat8(boxMin[1]) - vfloat8::load(packet.oy)) * vfloat8::load(packet.invDy);
+	t1 = (vfloat8(boxMax[1]) - vfloat8::load(packet.oy)) * vfloat8::load(packet.invDy);
+	tNear = vmax(tNear, vmin(t0, t1));
+	tFar = vmin(tFar, vmax(t0, t1));
+
+	t0 = (vfloat8(boxMin[2]) - vfloat8::load(packet.oz)) * vfloat8::load(packet.invDz);
+	t1 = (vfloat8(boxMax[2]) - vfloat8::load(packet.oz)) * vfloat8::load(packet.invDz);
+	tNear = vmax(tNear, vmin(t0, t1));
+	tFar = vmin(tFar, vmax(t0, t1));
+
+	vbool8 hit = activeLanes(packet) & (tNear <= tFar) & (tFar > vfloat8(0.0f))
+		& (tNear < vfloat8::load(packet.t));
+
+	int mask = movemask(hit);
+	if (mask == 0)
+		return false;
+
+	alignas(32) float entries[PACKET_SIZE];
+	tNear.store(entries);
+	tEntry = RAY_T_MAX;
+	for (int i=0; i < PACKET_SIZE; i++) {
+		if (mask & (1 << i))
+			tEntry = minOf(tEntry, entries[i]);
+	}
+
+	return true;
+}
+
+
+extern const PacketKernels kernels = {
+	PACKET_KERNELS_NAME,
+	intersectSpherePacket,
+	intersectPlanePacket,
+	intersectTrianglePacket,
+	intersectMeshTrianglePacket,
+	intersectBoxPacket
+};
+
+} // namespace PACKET_KERNELS_ISA
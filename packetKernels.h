@@ -0,0 +1,30 @@
+#pragma once
+
+#include "rayPacket.h"
+
+
+// packetKernels.cpp is compiled once per instruction set, every build with
+// its own PACKET_KERNELS_ISA namespace so that their vfloat8 types and
+// inline helpers (see simd.h) never get mixed up by the linker. Each build
+// exports its kernels as the table below.
+//
+// x86-64 builds get sse2 (which every x86-64 CPU has), sse42 (the same
+// with SSE4.1 blends for the selects), avx2 and avx512. Packets are 8
+// wide, so avx512 is the AVX2 code compiled with AVX-512VL, i.e. EVEX
+// encoding, 32 registers and mask registers for the compares. Other
+// architectures get one native build.
+
+#if defined(__x86_64__) || defined(__i386__)
+namespace packet_sse2 { extern const PacketKernels kernels; }
+namespace packet_sse42 { extern const PacketKernels kernels; }
+namespace packet_avx2 { extern const PacketKernels kernels; }
+namespace packet_avx512 { extern const PacketKernels kernels; }
+#else
+namespace packet_native { extern const PacketKernels kernels; }
+#endif
+
+
+// The best set this CPU supports, unless the environment variable
+// RAYTRACE_KERNELS names a supported one (sse2, sse42, avx2, avx512) to
+// compare them against each other.
+const PacketKernels* selectPacketKernels();
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cmath>
+
+#include "vectormath.h"
+#include "ray.h"
+
+
+// single ray tests of the built in primitives on plain data. The Shape
+// classes run them on their members and Scene on its arrays, so both find
+// the very same hits. t is the nearest hit in (RAY_T_MIN, tMax).
+
+
+inline bool intersectPlaneRay(const Point& position, const Vector& normal,
+	const Ray& ray, float tMax, float& t) {
+
+	float dDotN = dot(ray.direction, normal);
+
+	if (dDotN == 0.0f)
+	{
+		// We just assume the ray is not embedded in the plane
+		return false;
+	}
+
+	// Find point of intersection
+	float tHit = dot(position - ray.origin, normal) / dDotN;
+
+	if (tHit <= RAY_T_MIN || tHit >= tMax)
+	{
+		// Outside relevant range
+		return false;
+	}
+
+	t = tHit;
+	return true;
+}
+
+
+inline bool intersectTriangleRay(const Point& A, const Point& B, const Point& C,
+	const Point& position, const Vector& normal, const Ray& ray, float tMax, float& t) {
+
+	float tHit;
+	if (!intersectPlaneRay(position, normal, ray, tMax, tHit))
+		return false;
+
+	Point Q = ray.calculate(tHit);
+
+	// by looking at the sign of the the cross product we can identify
+	// if the point lies to the left or right of the vector
+	// so checking where Q lies relative to the edges of the triangle
+	// we can verify whether Q lies inside the triangle
+
+	if ( dot( cross(C-B, Q-B), normal ) >= 0 &&
+		 dot( cross(A-C, Q-C), normal ) >= 0 &&
+		 dot( cross(B-A, Q-A), normal ) >= 0)
+	{
+		// Q lies inside the triangle ABC
+		t = tHit;
+		return true;
+	}
+
+	return false;
+}
+
+
+inline bool intersectSphereRay(const Point& center, float radius,
+	const Ray& ray, float tMax, float& t) {
+
+	// bring sphere at the origin first
+	Vector origin = ray.origin - center;
+
+	// quadratic coefficients
+	float a = dot(ray.direction, ray.direction);
+	float b = 2 * dot(origin, ray.direction);
+	float c = dot(origin, origin) - radius*radius;
+
+	// check if we intersect
+	float discriminant = b*b - 4*a*c;
+
+	if (discriminant < 0.0f)
+		return false;
+
+	if (2*a == 0.0f)
+		return false; // infinite solution
+
+	// two points of intersections, t0 <= t1
+	float t0 = (-b - std::sqrt(discriminant)) / 2*a;
+	float t1 = (-b + std::sqrt(discriminant)) / 2*a;
+
+	// first check if smaller t is valid
+	if (t0 > RAY_T_MIN && t0 < tMax) {
+		t = t0;
+		return true;
+	}
+
+	if (t1 > RAY_T_MIN && t1 < tMax) {
+		t = t1;
+		return true;
+	}
+
+	return false;
+}
@@ -11,21 +11,17 @@
 
 struct Ray
 {
-	Point origin; // start
+	Point origin = Point(0.0f, 0.0f, 0.0f); // start
 	Vector direction;
-	float tMax;
-	bool invalid;
+	float tMax = RAY_T_MAX;
+	bool invalid = false;
 
-	Ray();
-	Ray(const Ray& r);
+	Ray() {}
 	Ray(const Point& origin, const Vector& direction,
-		float tMax = RAY_T_MAX);
+		float tMax = RAY_T_MAX)
+		: origin(origin), direction(direction), tMax(tMax) {}
 
-	virtual ~Ray();
-
-	Ray& operator =(const Ray& r);
-
-	Point calculate(float t) const;
+	Point calculate(float t) const { return origin + direction * t; }
 };
 
 class Shape;
@@ -33,18 +29,14 @@ class Shape;
 struct Intersection
 {
 	Ray ray;
-	float t;
-	Shape *pShape;
+	float t = RAY_T_MAX;
+	Shape *pShape = nullptr;
+	int primitiveId = -1; // which part of pShape was hit, e.g. the triangle of a mesh
 	Color color;
 
-	Intersection();
-	Intersection(const Intersection& i);
-	Intersection(const Ray& ray);
-
-	virtual ~Intersection();
+	Intersection() {}
+	Intersection(const Ray& ray) : ray(ray), t(ray.tMax) {}
 
-	Intersection& operator =(const Intersection& i);
-
-	bool intersected() const;
-	Point position() const;
-};
\ No newline at end of file
+	bool intersected() const { return pShape != nullptr; }
+	Point position() const { return ray.calculate(t); }
+};
@@ -2,32 +2,37 @@
 
 #include <iostream>
 
+#include "lightSet.h"
 
-Color castRay(const Ray& ray, Shape* scene, LightSource& lightSource) {
+
+Color castRay(const Ray& ray, Shape* scene, const LightSet& lights) {
 
 	Color color(0.0f);
 
 	Intersection intersection(ray);
 
 	if (scene->intersect(intersection)) {
-		// determine shadow
+		// determine shadow, one ray per light
 
 		Point hitPoint = ray.calculate(intersection.t);
 
-		Ray shadowRay = Ray();
-		shadowRay.origin = hitPoint;
-		shadowRay.direction = lightSource.position - shadowRay.origin;
-		float length2 = dot(shadowRay.direction, shadowRay.direction);
-		shadowRay.direction.normalize();
-
-		Intersection shadowIntersection(shadowRay);
+		for (int i=0; i < lights.getLightCount(); i++) {
+			const LightSource& light = lights.getLight(i);
 
-		//  if no intersection than no shadow
-		//  but if it intersected but away from the light source than also no shadow
+			Ray shadowRay = Ray();
+			shadowRay.origin = hitPoint;
+			shadowRay.direction = light.position - shadowRay.origin;
+			float length2 = dot(shadowRay.direction, shadowRay.direction);
+			shadowRay.direction.normalize();
 
-		if (!scene->intersect(shadowIntersection) || pow(shadowIntersection.t, 2) >= length2 )
-			color = intersection.color * lightSource.brightness * (1.0/length2); // inverse square law	
+			//  only what lies between the hit point and the light casts a shadow,
+			//  no lensing here so transparent objects shadow as well
 
+			const MaterialProperty* lens = NULL;
+			if (!scene->occluded(shadowRay, sqrt(length2), lens) && lens == NULL)
+				color += intersection.color * (light.brightness * light.getFalloff(hitPoint))
+					* (1.0/length2); // inverse square law
+		}
 	}
 
 	return color;
@@ -35,12 +40,12 @@ Color castRay(const Ray& ray, Shape* scene, LightSource& lightSource) {
 
 
 
-void rayCast(Image& image, Camera* camera, Shape* scene, LightSource& lightSource) {
+void rayCast(Image& image, Camera* camera, Shape* scene, const LightSet& lights) {
 	
 	std::cout << " rayCasting " << std::endl;
 
 	for (int x=0; x < image.getWidth(); x++) {
-		for (int y=0; y < image.getHeight(); y++) {
+		for (int y = image.getFirstRow(); y < image.getFirstRow() + image.getRowCount(); y++) {
 			
 			float xx = (2.0f*x) / image.getWidth() - 1.0f; // from -1 to 1
 			float yy = (-2.0f*y) / image.getHeight() + 1.0f; // from 1 to -1
@@ -50,7 +55,7 @@ void rayCast(Image& image, Camera* camera, Shape* scene, LightSource& lightSourc
 
 
 			Color* pixelColor = image.getPixel(x, y);
-			*pixelColor = castRay(ray, scene, lightSource);
+			*pixelColor = castRay(ray, scene, lights);
 		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "rayPacket.h"
+#include "packetKernels.h"
+#include "shape.h"
+
+
+const PacketKernels* selectPacketKernels() {
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	// best first, with what the CPU needs for them
+	struct Candidate {
+		const PacketKernels* kernels;
+		bool supported;
+	} candidates[] = {
+		{ &packet_avx512::kernels, __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") },
+		{ &packet_avx2::kernels, (bool)__builtin_cpu_supports("avx2") },
+		{ &packet_sse42::kernels, (bool)__builtin_cpu_supports("sse4.2") },
+		{ &packet_sse2::kernels, true }
+	};
+
+	const char* requested = getenv("RAYTRACE_KERNELS");
+	for (const auto& candidate: candidates) {
+		if (!candidate.supported)
+			continue;
+		if (!requested || !strcmp(requested, candidate.kernels->isa))
+			return candidate.kernels;
+	}
+
+	// not supported here or misspelled, the best it is
+	for (const auto& candidate: candidates) {
+		if (candidate.supported)
+			return candidate.kernels;
+	}
+	return &packet_sse2::kernels;
+#else
+	return &packet_native::kernels;
+#endif
+}
+
+
+const PacketKernels* packetKernels = selectPacketKernels();
+
+
+RayPacket::RayPacket(const Ray rays[], int count) {
+
+	activeMask = 0;
+	coherent = true;
+
+	for (int i=0; i < PACKET_SIZE; i++) {
+		// inactive lanes repeat the first ray so they don't widen the bounds
+		const Ray& ray = rays[i < count ? i : 0];
+
+		ox[i] = ray.origin.x;
+		oy[i] = ray.origin.y;
+		oz[i] = ray.origin.z;
+		dx[i] = ray.direction.x;
+		dy[i] = ray.direction.y;
+		dz[i] = ray.direction.z;
+		invDx[i] = 1.0f / dx[i];
+		invDy[i] = 1.0f / dy[i];
+		invDz[i] = 1.0f / dz[i];
+		t[i] = (i < count) ? ray.tMax : -RAY_T_MAX;
+		pShape[i] = NULL;
+		primitiveId[i] = -1;
+
+		if (i < count)
+			activeMask |= 1 << i;
+	}
+
+	const float* origins[3] = { ox, oy, oz };
+	const float* invDirections[3] = { invDx, invDy, invDz };
+
+	for (int axis=0; axis < 3; axis++) {
+		originMin[axis] = *std::min_element(origins[axis], origins[axis] + PACKET_SIZE);
+		originMax[axis] = *std::max_element(origins[axis], origins[axis] + PACKET_SIZE);
+		invDirectionMin[axis] = *std::min_element(invDirections[axis], invDirections[axis] + PACKET_SIZE);
+		invDirectionMax[axis] = *std::max_element(invDirections[axis], invDirections[axis] + PACKET_SIZE);
+
+		if (invDirectionMin[axis] < 0.0f && invDirectionMax[axis] > 0.0f)
+			coherent = false;
+	}
+}
+
+
+void RayPacket::record(int hitMask, Shape* shape, const Color& color, int primitiveId) {
+
+	for (int i=0; i < PACKET_SIZE; i++) {
+		if (hitMask & (1 << i)) {
+			pShape[i] = shape;
+			this->primitiveId[i] = primitiveId;
+			this->color[i] = color;
+		}
+	}
+}
+
+
+Intersection RayPacket::getIntersection(int lane) const {
+
+	Intersection intersection(Ray(Point(ox[lane], oy[lane], oz[lane]),
+		Vector(dx[lane], dy[lane], dz[lane])));
+	intersection.t = t[lane];
+	intersection.pShape = pShape[lane];
+	intersection.primitiveId = primitiveId[lane];
+	intersection.color = color[lane];
+	return intersection;
+}
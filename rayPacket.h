@@ -0,0 +1,91 @@
+#pragma once
+
+#include "vectormath.h"
+#include "color.h"
+#include "ray.h"
+
+class Shape;
+
+
+const int PACKET_SIZE = 8;
+
+
+// PACKET_SIZE rays in structure of arrays layout, so that the kernels in
+// rayPacket.cpp can intersect all of them with one primitive at once.
+// Meant for coherent rays like neighbouring camera rays.
+struct RayPacket {
+	alignas(32) float ox[PACKET_SIZE], oy[PACKET_SIZE], oz[PACKET_SIZE];
+	alignas(32) float dx[PACKET_SIZE], dy[PACKET_SIZE], dz[PACKET_SIZE];
+	alignas(32) float invDx[PACKET_SIZE], invDy[PACKET_SIZE], invDz[PACKET_SIZE];
+	alignas(32) float t[PACKET_SIZE]; // closest hit so far, same as Intersection::t
+
+	Shape* pShape[PACKET_SIZE];
+	int primitiveId[PACKET_SIZE];
+	Color color[PACKET_SIZE];
+	int activeMask; // bit i set = lane i carries a ray
+
+	// bounds over all lanes, a box that no ray inside these bounds can hit
+	// is culled with one interval test instead of PACKET_SIZE slab tests.
+	// Only usable when the directions don't change sign within the packet.
+	float originMin[3], originMax[3];
+	float invDirectionMin[3], invDirectionMax[3];
+	bool coherent;
+
+	// rays beyond count are inactive lanes
+	RayPacket(const Ray rays[], int count);
+
+	// stores the hit for the lanes in hitMask, called after a kernel shrank their t
+	void record(int hitMask, Shape* shape, const Color& color, int primitiveId = -1);
+
+	Intersection getIntersection(int lane) const;
+};
+
+
+// The intersection kernels of packetKernels.cpp. That file is built once
+// per instruction set and when the program starts the best set the CPU
+// supports is picked, see packetKernels.h.
+struct PacketKernels {
+	const char* isa;
+
+	int (*intersectSphere)(RayPacket& packet, const Point& center, float radius);
+	int (*intersectPlane)(RayPacket& packet, const Point& position, const Vector& normal);
+	int (*intersectTriangle)(RayPacket& packet, const Point& A, const Point& B,
+		const Point& C, const Point& position, const Vector& normal);
+	int (*intersectMeshTriangle)(RayPacket& packet, const float v0[3],
+		const float e1[3], const float e2[3]);
+	bool (*intersectBox)(const RayPacket& packet, const float boxMin[3],
+		const float boxMax[3], float& tEntry);
+};
+
+// the set in use
+extern const PacketKernels* packetKernels;
+
+
+// intersection kernels, the same math as the scalar Shape::intersect
+// versions. Each returns the mask of lanes whose t got shorter.
+inline int intersectSpherePacket(RayPacket& packet, const Point& center, float radius) {
+	return packetKernels->intersectSphere(packet, center, radius);
+}
+
+inline int intersectPlanePacket(RayPacket& packet, const Point& position, const Vector& normal) {
+	return packetKernels->intersectPlane(packet, position, normal);
+}
+
+inline int intersectTrianglePacket(RayPacket& packet, const Point& A, const Point& B,
+	const Point& C, const Point& position, const Vector& normal) {
+	return packetKernels->intersectTriangle(packet, A, B, C, position, normal);
+}
+
+// Moeller-Trumbore against one triangle of a mesh given by its first vertex
+// and the two edges leaving it
+inline int intersectMeshTrianglePacket(RayPacket& packet, const float v0[3],
+	const float e1[3], const float e2[3]) {
+	return packetKernels->intersectMeshTriangle(packet, v0, e1, e2);
+}
+
+// true if some active lane enters the box before its t, tEntry is then
+// the nearest entry among those lanes
+inline bool intersectBoxPacket(const RayPacket& packet, const float boxMin[3],
+	const float boxMax[3], float& tEntry) {
+	return packetKernels->intersectBox(packet, boxMin, boxMax, tEntry);
+}
@@ -1,12 +1,22 @@
 #pragma once
 
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <memory>
+#include <vector>
+
+#include "denoise.h"
+#include "lightSet.h"
+#include "renderSettings.h"
+#include "sampler.h"
+#include "tileScheduler.h"
+#include "rayPacket.h"
+#include "stats.h"
 using namespace std;
 
 
-const int MAX_RECUR_DEPTH = 3;
 const float ka = 0.73; // ambient light coeff
 const int ns = 64; // exponent of cos for specular light
 				  // generally multiple of 2
@@ -34,6 +44,7 @@ Ray refract(const Ray& ray, const Vector& normalVec, const Point& hitPosition,
 	const float sinR2 = n*n * (1.0 - cosI*cosI);
 	if (sinR2 >= 1.0) {
 		// total internal reflection, returning invalid ray
+		STATS_COUNT(STAT_TOTAL_INTERNAL_REFLECTIONS);
 		Ray invalidRay;
 		invalidRay.invalid = true;
 		return invalidRay;
@@ -53,36 +64,83 @@ Ray refract(const Ray& ray, const Vector& normalVec, const Point& hitPosition,
 
 
 
-Color castRay(const Ray& ray, Shape* scene, LightSource& lightSource, int depth) {
+// what a hit looks like before any further ray is traced: the light it
+// gets if nothing is in the way and the rays it spawns. Shared by the
+// recursive castRay() and the wavefront tracer in wavefront.h.
+struct HitShading {
+	const MaterialProperty* material;
 
-	Color color(0.0f);
+	bool lit; // false if no light reaches the hit, it only gets ambient light
+	Ray shadowRay; // towards the light picked for the hit
+	float lightDistance;
+	Color directColor; // Phong shading, if the light isn't blocked
 
-	if (depth > MAX_RECUR_DEPTH)
-		return color;
+	bool reflected, refracted;
+	Ray reflectedRay, refractedRay;
+};
 
-	Intersection intersection(ray);
 
-	if (scene->intersect(intersection)) {
-		// determine shadow
+// The random numbers a hit's light sample is made of. Camera ray hits
+// take them from the sampler of their pixel, see makeLightDice(), so they
+// are stratified over the samples of a pixel like the positions in it.
+struct LightDice {
+	float pick;   // which light, see LightSet::pickLight()
+	Vector2 area; // where on a sphere light
+};
 
-		Point hitPoint = ray.calculate(intersection.t);
 
-		Ray shadowRay = Ray();
-		shadowRay.origin = hitPoint;
-		shadowRay.direction = lightSource.position - shadowRay.origin;
-		float length2 = dot(shadowRay.direction, shadowRay.direction);
-		shadowRay.direction.normalize();
+// dimension 1 of the sampler picks the light, dimension 2 the point on it
+LightDice makeLightDice(const Sampler& sampler, int x, int y, int sample) {
+
+	LightDice dice;
+	dice.pick = sampler.get1D(x, y, sample, 1);
+	dice.area = sampler.get2D(x, y, sample, 2);
+	return dice;
+}
 
-		Vector normalVector = intersection.pShape->getNormalVector(hitPoint);
-		MaterialProperty material = intersection.pShape->getMaterialProperty();
 
-		Intersection shadowIntersection(shadowRay);
+// dice are those of a camera ray hit, NULL for deeper hits
+HitShading prepareShading(const Ray& ray, const Intersection& intersection,
+	const LightSet& lights, const LightDice* dice = NULL) {
 
-		//  if no intersection than no shadow
-		//  but if it intersected but away from the light source than also no shadow
+	HitShading shading;
 
-		Color directColor(0.0f);
+	Point hitPoint = ray.calculate(intersection.t);
 
+	Vector normalVector = intersection.pShape->getNormalVector(intersection);
+	const MaterialProperty& material = intersection.pShape->getMaterialProperty(intersection);
+	shading.material = &material;
+
+	// one light per hit, see LightSet. Without dice they are a hash of the
+	// hit so the image doesn't depend on threads, a single point light
+	// needs none.
+	const float hitValues[] = { hitPoint.x, hitPoint.y, hitPoint.z,
+		ray.direction.x, ray.direction.y, ray.direction.z };
+	float pick = 0.0f;
+	if (lights.getLightCount() > 1)
+		pick = dice ? dice->pick : hashToFloat(hitValues, 6, 0);
+	int lightIndex;
+	float probability;
+	shading.lit = lights.pickLight(hitPoint, pick, lightIndex, probability);
+
+	if (!shading.lit)
+		shading.directColor = ka * intersection.color;
+
+	else {
+		const LightSource& light = lights.getLight(lightIndex);
+		Vector2 area(0.0f, 0.0f);
+		if (light.type == LIGHT_SPHERE)
+			area = dice ? dice->area : Vector2(hashToFloat(hitValues, 6, 1), hashToFloat(hitValues, 6, 2));
+
+		Ray& shadowRay = shading.shadowRay;
+		shadowRay.origin = hitPoint;
+		shadowRay.direction = light.samplePosition(hitPoint, area) - shadowRay.origin;
+		float length2 = dot(shadowRay.direction, shadowRay.direction);
+		shadowRay.direction.normalize();
+		shading.lightDistance = sqrt(length2);
+
+		// what the light gives, divided by the probability of the pick
+		float weight = light.getFalloff(hitPoint) / probability;
 
 		// reflection ray of -shadow light (i.e light from source):
 		//  needed inorder to find the true direction of specular light
@@ -92,93 +150,156 @@ Color castRay(const Ray& ray, Shape* scene, LightSource& lightSource, int depth)
 		specularRay.direction = -specularRay.direction;
 		specularRay = reflect(specularRay, normalVector, hitPoint);
 
+		// Phong Shading, as we have normal to any hit Point
+		shading.directColor = ka * intersection.color 
+					  +
+					 	intersection.color * (light.brightness * weight)
+					  	  * dot(shadowRay.direction, normalVector) 
+					  	  * (1.0/length2) 
+					  +
+					  	ks * pow( dot(specularRay.direction, normalVector), ns) * intersection.color * weight;
+
+		// inverse square law + lambert cosine law + specular cos^ns law
+		// ambient + diffused + specular lights
+	}
 
-		Intersection shadowIntersection2(shadowRay);
 
-		if (!scene->intersect(shadowIntersection) || pow(shadowIntersection.t, 2) >= length2 ) 
-		{
-			// Phong Shading, as we have normal to any hit Point
-			directColor = ka * intersection.color 
-						  +
-						 	intersection.color * lightSource.brightness 
-						  	  * dot(shadowRay.direction, normalVector) 
-						  	  * (1.0/length2) 
-						  +
-						  	ks * pow( dot(specularRay.direction, normalVector), ns) * intersection.color;
+	// For reflection and refraction
 
-			// inverse square law + lambert cosine law + specular cos^ns law
-			// ambient + diffused + specular lights
-		}
-		
-		else if (shadowIntersection.t < RAY_T_MAX && pow(shadowIntersection.t, 2) < length2) {
-			// if intersecting object is transparent then certain light enters in
-			// so that shadow is not dark but the result of lensing of light
-
-			MaterialProperty lensMaterial = shadowIntersection.pShape->getMaterialProperty();
-			if (lensMaterial.transparency > 0.0f) {
-				// cout << "lens found confirmed!" << endl;
-				directColor = castRay(shadowRay, scene, lightSource, depth+1)
-								 * lensMaterial.transparency * material.reflection;
-			}
-		}
+	bool rayHittingFromInsideObject = false;
+	if (dot(normalVector, ray.direction) >= 0) {
+		 // this means ray was hitting from inside the object
+		normalVector = -normalVector;
+		rayHittingFromInsideObject = true;
+	}
 
-		color = directColor;		
+	// Reflection
 
-		// For reflection and refraction
+	shading.reflected = false;
 
-		bool rayHittingFromInsideObject = false;
-		if (dot(normalVector, ray.direction) >= 0) {
-			 // this means ray was hitting from inside the object
-			normalVector = -normalVector;
-			rayHittingFromInsideObject = true;
-		}
+	if (material.reflection > 0.0f) {
 
-		// Reflection
+		shading.reflectedRay = reflect(ray, normalVector, hitPoint);
+		shading.reflected = true;
+	}
 
-		bool reflected = false;
-		Ray reflectedRay;
+	// Refraction
 
-		if (material.reflection > 0.0f) {
+	shading.refracted = false;
 
-			reflectedRay = reflect(ray, normalVector, hitPoint);
-			reflected = true;
-		}
+	if (material.transparency > 0.0f) { 
+
+		float n1 = 1.0f; // air's refrc index 
+		float n2 = material.refractiveIndex; 
 
-		if (reflected) {
-			Color reflectedColor = castRay(reflectedRay, scene, lightSource, depth+1);
-			color += reflectedColor * material.reflection; // multiplying by reflection
-														   // coefficient
+		if (rayHittingFromInsideObject) {
+			float temp = n1;
+			n1 = n2;
+			n2 = temp;
 		}
 
-		bool refracted = false;
-		Ray refractedRay;
+		shading.refractedRay = refract(ray, normalVector, hitPoint, n1, n2);
+		if (!shading.refractedRay.invalid)
+			shading.refracted = true;
+	}
 
-		// Refraction
-		if (material.transparency > 0.0f) { 
+	return shading;
+}
 
-			float n1 = 1.0f; // air's refrc index 
-			float n2 = material.refractiveIndex; 
 
-			if (rayHittingFromInsideObject) {
-				float temp = n1;
-				n1 = n2;
-				n2 = temp;
-			}
 
-			refractedRay = refract(ray, normalVector, hitPoint, n1, n2);
-			if (!refractedRay.invalid)
-				refracted = true;
+// What a reflected, refracted or transmitted ray of the given depth is
+// scaled by on the way to the camera beyond its throughput, 0 if it isn't
+// traced. Throughput is the product of the reflection and transparency
+// factors the ray went through, a ray below settings.minThroughput can't
+// change the image much and is dropped. With Russian roulette it survives
+// with probability throughput / minThroughput instead and is scaled up by
+// the inverse, so the image stays right on average. The dice are a hash of
+// the ray, so which rays survive doesn't depend on threads or tile order.
+float rayWeight(const Ray& ray, int depth, float throughput, const RenderSettings& settings) {
+
+	if (depth > settings.maxDepth || throughput <= 0.0f)
+		return 0.0f;
+
+	if (throughput >= settings.minThroughput)
+		return 1.0f;
+
+	if (!settings.russianRoulette)
+		return 0.0f;
+
+	float survival = throughput / settings.minThroughput;
+	const float values[] = { ray.origin.x, ray.origin.y, ray.origin.z,
+		ray.direction.x, ray.direction.y, ray.direction.z };
+	if (hashToFloat(values, 6, depth) >= survival)
+		return 0.0f;
+
+	return 1.0f / survival;
+}
+
+
+Color castRay(const Ray& ray, Shape* scene, const LightSet& lights, int depth,
+	float throughput, const RenderSettings& settings);
+
+
+// color seen along ray which is known to hit the scene at intersection,
+// throughput is what that color is scaled by on the way to the camera.
+// dice only for camera rays, see prepareShading().
+Color shade(const Ray& ray, const Intersection& intersection, Shape* scene,
+	const LightSet& lights, int depth, float throughput, const RenderSettings& settings,
+	const LightDice* dice = NULL) {
+
+	HitShading shading = prepareShading(ray, intersection, lights, dice);
+	const MaterialProperty& material = *shading.material;
+
+	//  only what lies between the hit point and the light can cast a shadow,
+	//  the query stops at the first opaque shape it finds on the way
+
+	const MaterialProperty* lens = NULL;
+	bool inShadow = false;
+	if (shading.lit) {
+		STATS_RAY(RAY_SHADOW, depth);
+		inShadow = scene->occluded(shading.shadowRay, shading.lightDistance, lens);
+	}
+
+	Color color(0.0f);
+
+	if (!inShadow && lens == NULL)
+		color = shading.directColor;
+	
+	else if (!inShadow) {
+		// only transparent objects are in the way, certain light enters in
+		// so that shadow is not dark but the result of lensing of light
+
+		float transmitted = throughput * lens->transparency * material.reflection;
+		float weight = rayWeight(shading.shadowRay, depth+1, transmitted, settings);
+		if (weight > 0.0f) {
+			STATS_RAY(RAY_TRANSMITTED, depth+1);
+			color = castRay(shading.shadowRay, scene, lights, depth+1, transmitted * weight, settings)
+						 * lens->transparency * material.reflection * weight;
 		}
+	}
 
-		if (refracted) {
+	if (shading.reflected) {
+		float weight = rayWeight(shading.reflectedRay, depth+1, throughput * material.reflection, settings);
+		if (weight > 0.0f) {
+			STATS_RAY(RAY_REFLECTED, depth+1);
+			Color reflectedColor = castRay(shading.reflectedRay, scene, lights, depth+1,
+				throughput * material.reflection * weight, settings);
+			color += reflectedColor * material.reflection * weight; // multiplying by reflection
+																	// coefficient
+		}
+	}
 
-			Color refractedColor = castRay(refractedRay, scene, lightSource, depth+1);
+	if (shading.refracted) {
+		float weight = rayWeight(shading.refractedRay, depth+1, throughput * material.transparency, settings);
+		if (weight > 0.0f) {
+			STATS_RAY(RAY_REFRACTED, depth+1);
+			Color refractedColor = castRay(shading.refractedRay, scene, lights, depth+1,
+				throughput * material.transparency * weight, settings);
 			// cout << "refractedColor: " << refractedColor.r << ", " << refractedColor.g  
 			// 	 <<	", " << refractedColor.b << endl;
-			color += refractedColor * material.transparency; // multiplying by refraction bias											   // coefficient
+			color += refractedColor * material.transparency * weight; // multiplying by refraction bias
 		}
-
-
 	}
 
 	return color;
@@ -186,20 +307,295 @@ Color castRay(const Ray& ray, Shape* scene, LightSource& lightSource, int depth)
 
 
 
-void rayTrace(Image& image, Camera* camera, Shape* scene, LightSource& lightSource) {
-	
-	for (int x=0; x < image.getWidth(); x++) {
-		for (int y=0; y < image.getHeight(); y++) {
-			
-			float xx = (2.0f*x) / image.getWidth() - 1.0f; // from -1 to 1
-			float yy = (-2.0f*y) / image.getHeight() + 1.0f; // from 1 to -1
+Color castRay(const Ray& ray, Shape* scene, const LightSet& lights, int depth,
+	float throughput, const RenderSettings& settings) {
+
+	Intersection intersection(ray);
+
+	if (!scene->intersect(intersection))
+		return Color(0.0f);
+
+	return shade(ray, intersection, scene, lights, depth, throughput, settings);
+}
+
+
+
+// what the denoiser needs to know of a camera ray's hit, see denoise.h
+SurfaceFeatures getSurfaceFeatures(const Intersection& intersection) {
+
+	SurfaceFeatures features;
+	features.normal = intersection.pShape->getNormalVector(intersection);
+	features.albedo = intersection.pShape->getMaterialProperty(intersection).surfaceColor;
+	features.depth = intersection.t;
+	return features;
+}
 
-			Vector2 screenCoord(xx, yy);
-			Ray ray = camera->makeRay(screenCoord);
 
+// colors seen along count camera rays with the light dice of their
+// samples, the primary hits are found with one packet unless packets are
+// turned off. With hits the features of the primary hits go there as well.
+void traceCameraRays(const Ray rays[], const LightDice dice[], int count, Color colors[], Shape* scene,
+	const LightSet& lights, const RenderSettings& settings, SurfaceFeatures hits[] = NULL) {
 
-			Color* pixelColor = image.getPixel(x, y);
-			*pixelColor = castRay(ray, scene, lightSource, 0);
+	STATS_RAYS(RAY_CAMERA, 0, count);
+
+	if (!settings.usePackets) {
+		for (int i=0; i < count; i++) {
+			// castRay() with the dice, which keeps the intersection
+			Intersection intersection(rays[i]);
+			bool hit = scene->intersect(intersection);
+			colors[i] = hit ? shade(rays[i], intersection, scene, lights, 0, 1.0f, settings, &dice[i]) : Color(0.0f);
+			if (hits)
+				hits[i] = hit ? getSurfaceFeatures(intersection) : SurfaceFeatures();
 		}
+		return;
 	}
-}
\ No newline at end of file
+
+	// primary hits for all rays at once, the shading and all secondary
+	// rays are traced one by one as usual
+	RayPacket packet(rays, count);
+	scene->intersectPacket(packet);
+
+	for (int i=0; i < count; i++) {
+		Intersection intersection = packet.getIntersection(i);
+
+		if (intersection.intersected())
+			colors[i] = shade(rays[i], intersection, scene, lights, 0, 1.0f, settings, &dice[i]);
+		else
+			colors[i] = Color(0.0f);
+
+		if (hits)
+			hits[i] = intersection.intersected() ? getSurfaceFeatures(intersection) : SurfaceFeatures();
+	}
+}
+
+
+// the samples of one pixel taken so far, brightness is the mean of the
+// three channels which the variance is tracked for
+struct PixelSamples {
+	Color sum;
+	float brightnessSum, brightnessSum2;
+	int count;
+	SurfaceFeatures features; // summed, if AOVs are written
+
+	PixelSamples() : brightnessSum(0.0f), brightnessSum2(0.0f), count(0) {}
+
+	void add(const Color& color) {
+		float brightness = (color.r + color.g + color.b) / 3.0f;
+		sum += color;
+		brightnessSum += brightness;
+		brightnessSum2 += brightness * brightness;
+		count++;
+	}
+
+	Color mean() const { return sum * (1.0f / count); }
+
+	// standard error of the mean brightness
+	float error() const {
+		if (count < 2)
+			return 0.0f;
+		float mean = brightnessSum / count;
+		float variance = std::max(0.0f, brightnessSum2 / count - mean * mean);
+		return sqrt(variance / (count - 1));
+	}
+};
+
+
+// how different two pixels look on screen, the largest channel difference
+// after clamping to the displayable range like saveImagePPM() does
+float contrast(const Color& a, const Color& b) {
+
+	float dr = std::fabs(std::min(a.r, 1.0f) - std::min(b.r, 1.0f));
+	float dg = std::fabs(std::min(a.g, 1.0f) - std::min(b.g, 1.0f));
+	float db = std::fabs(std::min(a.b, 1.0f) - std::min(b.b, 1.0f));
+	return std::max(dr, std::max(dg, db));
+}
+
+
+// Adaptive anti-aliasing. First every pixel gets settings.minSamples
+// samples. Then pixels which differ from one of their 8 neighbours by more
+// than settings.aaThreshold, or whose own samples do, are refined in
+// batches of PACKET_SIZE until the error of their mean drops below half
+// the threshold or they have settings.maxSamples. Flat regions stay at
+// the minimum, so edges end up close to maxSamples supersampled for a
+// fraction of the rays. Returns the number of samples traced. With aovs
+// the features of the hits are averaged over the samples like the colors.
+long long rayTraceAdaptive(Image& image, Camera* camera, Shape* scene, const LightSet& lights,
+	const RenderSettings& settings, TileScheduler& scheduler, AOVBuffers* aovs = NULL) {
+
+	int width = image.getWidth();
+	int height = image.getHeight();
+	int minSamples = std::max(1, std::min(settings.minSamples, settings.maxSamples));
+
+	// rows of the band the image holds, plus the row above and below which
+	// the first pass also samples for the neighbour check, so bands get
+	// refined exactly like the whole frame would be
+	int y0 = image.getFirstRow(), y1 = y0 + image.getRowCount();
+	int top = std::max(0, y0 - 1), bottom = std::min(height, y1 + 1);
+
+	std::vector<Tile> tiles = makeTiles(width, y0, y1, settings.tileSize);
+	std::vector<Tile> initialTiles = tiles;
+	if (top < y0)
+		initialTiles.push_back({ 0, top, width, y0 });
+	if (bottom > y1)
+		initialTiles.push_back({ 0, y1, width, bottom });
+
+	// dimension 0 of the sampler is the position within the pixel, 1 and 2
+	// the light sample, see makeLightDice()
+	std::unique_ptr<Sampler> sampler = makeSampler(settings.sampler, settings.maxSamples);
+
+	auto sampleRay = [&](int x, int y, int sample) {
+		Vector2 offset = sampler->get2D(x, y, sample, 0);
+		float xx = (2.0f*(x + offset.u)) / width - 1.0f; // from -1 to 1
+		float yy = (-2.0f*(y + offset.v)) / height + 1.0f; // from 1 to -1
+		return camera->makeRay(Vector2(xx, yy));
+	};
+
+	// first pass, every pixel at the minimum. Kept apart from the image so
+	// the second pass can look at the neighbours in other tiles while they
+	// are being refined.
+	std::vector<PixelSamples> initial((size_t)width * (bottom - top));
+
+	scheduler.run(initialTiles, [&](const Tile& tile, int thread) {
+		for (int sample = 0; sample < minSamples; sample++) {
+			for (int x = tile.x0; x < tile.x1; x++) {
+				for (int y = tile.y0; y < tile.y1; y += PACKET_SIZE) {
+					int count = std::min(PACKET_SIZE, tile.y1 - y);
+					Ray rays[PACKET_SIZE];
+					LightDice dice[PACKET_SIZE];
+					Color colors[PACKET_SIZE];
+					SurfaceFeatures hits[PACKET_SIZE];
+
+					for (int i=0; i < count; i++) {
+						rays[i] = sampleRay(x, y+i, sample);
+						dice[i] = makeLightDice(*sampler, x, y+i, sample);
+					}
+
+					traceCameraRays(rays, dice, count, colors, scene, lights, settings, aovs ? hits : NULL);
+
+					for (int i=0; i < count; i++) {
+						PixelSamples& pixel = initial[x + (size_t)(y+i - top) * width];
+						pixel.add(colors[i]);
+						if (aovs)
+							pixel.features.add(hits[i]);
+					}
+				}
+			}
+		}
+	});
+
+	std::vector<long long> sampleCounts(scheduler.getThreadCount(), 0);
+
+	scheduler.run(tiles, [&](const Tile& tile, int thread) {
+		for (int y = tile.y0; y < tile.y1; y++) {
+			for (int x = tile.x0; x < tile.x1; x++) {
+				PixelSamples pixel = initial[x + (size_t)(y - top) * width];
+				Color mean = pixel.mean();
+
+				bool refine = pixel.error() * 2.0f > settings.aaThreshold;
+				for (int ny = std::max(top, y-1); ny <= std::min(bottom-1, y+1) && !refine; ny++)
+					for (int nx = std::max(0, x-1); nx <= std::min(width-1, x+1) && !refine; nx++)
+						refine = contrast(mean, initial[nx + (size_t)(ny - top) * width].mean()) > settings.aaThreshold;
+
+				// a batch of neighbouring samples of one pixel makes a
+				// very coherent packet
+				while (refine && pixel.count < settings.maxSamples) {
+					int count = std::min(PACKET_SIZE, settings.maxSamples - pixel.count);
+					Ray rays[PACKET_SIZE];
+					LightDice dice[PACKET_SIZE];
+					Color colors[PACKET_SIZE];
+					SurfaceFeatures hits[PACKET_SIZE];
+
+					for (int i=0; i < count; i++) {
+						rays[i] = sampleRay(x, y, pixel.count + i);
+						dice[i] = makeLightDice(*sampler, x, y, pixel.count + i);
+					}
+
+					traceCameraRays(rays, dice, count, colors, scene, lights, settings, aovs ? hits : NULL);
+
+					for (int i=0; i < count; i++) {
+						pixel.add(colors[i]);
+						if (aovs)
+							pixel.features.add(hits[i]);
+					}
+
+					refine = pixel.error() * 2.0f > settings.aaThreshold;
+				}
+
+				*image.getPixel(x, y) = pixel.mean();
+				sampleCounts[thread] += pixel.count;
+
+				if (aovs) {
+					pixel.features.scale(1.0f / pixel.count);
+					aovs->set(x, y, pixel.features);
+				}
+			}
+		}
+	});
+
+	long long samples = 0;
+	for (long long count: sampleCounts)
+		samples += count;
+
+	return samples;
+}
+
+
+
+// renders the rows the image holds, all of them unless it is a band, and
+// returns the number of camera samples traced. With aovs the features of
+// the first hits are written there too, for denoiseImage().
+long long rayTrace(Image& image, Camera* camera, Shape* scene, const LightSet& lights,
+	const RenderSettings& settings = RenderSettings(), AOVBuffers* aovs = NULL) {
+
+	// every pixel only depends on its own coordinates, so the tiles can
+	// be traced in any order and on any thread with the same result
+	TileScheduler scheduler(settings.threadCount);
+
+	if (aovs)
+		aovs->resize(image);
+
+	if (settings.maxSamples > 1)
+		return rayTraceAdaptive(image, camera, scene, lights, settings, scheduler, aovs);
+
+	std::vector<Tile> tiles = makeTiles(image.getWidth(), image.getFirstRow(),
+		image.getFirstRow() + image.getRowCount(), settings.tileSize);
+
+	// only for the light samples, see makeLightDice()
+	std::unique_ptr<Sampler> sampler = makeSampler(settings.sampler, 1);
+
+	// a single ray through the corner of every pixel
+	scheduler.run(tiles, [&](const Tile& tile, int thread) {
+		for (int x = tile.x0; x < tile.x1; x++) {
+			for (int y = tile.y0; y < tile.y1; y += PACKET_SIZE) {
+
+				// a column of up to PACKET_SIZE neighbouring camera rays
+				int count = std::min(PACKET_SIZE, tile.y1 - y);
+				Ray rays[PACKET_SIZE];
+				LightDice dice[PACKET_SIZE];
+				Color colors[PACKET_SIZE];
+				SurfaceFeatures hits[PACKET_SIZE];
+
+				for (int i=0; i < count; i++) {
+					dice[i] = makeLightDice(*sampler, x, y+i, 0);
+
+					float xx = (2.0f*x) / image.getWidth() - 1.0f; // from -1 to 1
+					float yy = (-2.0f*(y+i)) / image.getHeight() + 1.0f; // from 1 to -1
+
+					Vector2 screenCoord(xx, yy);
+					rays[i] = camera->makeRay(screenCoord);
+				}
+
+				traceCameraRays(rays, dice, count, colors, scene, lights, settings, aovs ? hits : NULL);
+
+				for (int i=0; i < count; i++) {
+					*image.getPixel(x, y+i) = colors[i];
+					if (aovs)
+						aovs->set(x, y+i, hits[i]);
+				}
+			}
+		}
+	});
+
+	return (long long)image.getWidth() * image.getRowCount();
+}
@@ -0,0 +1,265 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "renderServer.h"
+#include "sockets.h"
+#include "trace.h"
+
+
+static bool parseNumber(const std::string& text, float& value) {
+
+	char* end;
+	value = strtof(text.c_str(), &end);
+	return !text.empty() && *end == '\0';
+}
+
+
+static bool parseInt(const std::string& text, int& value) {
+
+	char* end;
+	value = strtol(text.c_str(), &end, 10);
+	return !text.empty() && *end == '\0';
+}
+
+
+// "x,y,z"
+static bool parseVector(const std::string& text, Vector& value) {
+
+	float x, y, z;
+	int length = 0;
+	if (sscanf(text.c_str(), "%f,%f,%f%n", &x, &y, &z, &length) != 3 || length != (int)text.size())
+		return false;
+	value = Vector(x, y, z);
+	return true;
+}
+
+
+bool parseRenderRequest(const std::string& line, RenderRequest& request, std::string& error) {
+
+	std::istringstream words(line);
+	std::string word;
+
+	while (words >> word) {
+		size_t equals = word.find('=');
+		if (equals == std::string::npos) {
+			error = "expected key=value, got " + word;
+			return false;
+		}
+		std::string key = word.substr(0, equals), value = word.substr(equals + 1);
+
+		bool ok = true;
+		if (key == "width")
+			ok = parseInt(value, request.width) && request.width > 0 && request.width <= MAX_REQUEST_SIZE;
+		else if (key == "height")
+			ok = parseInt(value, request.height) && request.height > 0 && request.height <= MAX_REQUEST_SIZE;
+		else if (key == "camera")
+			ok = parseVector(value, request.cameraPosition);
+		else if (key == "target")
+			ok = parseVector(value, request.cameraTarget);
+		else if (key == "up")
+			ok = parseVector(value, request.cameraUp);
+		else if (key == "fov")
+			ok = parseNumber(value, request.fov) && request.fov > 0.0f && request.fov < 180.0f;
+		else if (key == "samples")
+			ok = parseInt(value, request.samples) && request.samples > 0;
+		else if (key == "time")
+			ok = parseNumber(value, request.time);
+		else if (key == "format") {
+			if (value == "ppm")
+				request.format = IMAGE_PPM;
+			else if (value == "png")
+				request.format = IMAGE_PNG;
+			else if (value == "qoi")
+				request.format = IMAGE_QOI;
+			else
+				ok = false;
+		}
+		else {
+			error = "unknown key " + key;
+			return false;
+		}
+
+		if (!ok) {
+			error = "bad value for " + key + ": " + value;
+			return false;
+		}
+	}
+
+	long long pixels = (long long)request.width * request.height;
+	if (pixels > MAX_REQUEST_PIXELS || pixels * request.samples > MAX_REQUEST_SAMPLES) {
+		error = "the image is too big or has too many samples";
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool sendLine(int socket, const std::string& line) {
+	return sendAll(socket, (line + "\n").data(), line.size() + 1);
+}
+
+
+// renders one request line and replies, false once the client is gone
+static bool serveRequest(int client, const std::string& line, const RenderRequest& defaults,
+	const RequestRenderer& render, int threadCount) {
+
+	TRACE_SCOPE("request");
+	auto start = std::chrono::steady_clock::now();
+
+	RenderRequest request = defaults;
+	std::string error;
+	if (!parseRenderRequest(line, request, error))
+		return sendLine(client, "error " + error);
+
+	Image image(request.width, request.height);
+	if (!render(request, image))
+		return sendLine(client, "error couldn't render the request");
+
+	std::vector<unsigned char> rgb((size_t)request.width * request.height * 3);
+	image.toRGB8(rgb.data());
+
+	std::vector<unsigned char> encoded;
+	std::unique_ptr<ImageStream> stream = openImageStream(encoded, request.format,
+		request.width, request.height, threadCount);
+
+	if (!stream || !stream->writeRows(rgb.data(), request.height) || !stream->close())
+		return sendLine(client, "error couldn't encode the image");
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << " " << line << " (" << (int)milliseconds << " ms)" << std::endl;
+
+	char reply[64];
+	snprintf(reply, sizeof(reply), "ok %zu %.1f", encoded.size(), milliseconds);
+	return sendLine(client, reply) && sendAll(client, encoded.data(), encoded.size());
+}
+
+
+bool runRenderServer(const std::string& address, const RenderRequest& defaults,
+	const RequestRenderer& render, int threadCount) {
+
+	if (!isLocalAddress(address)) {
+		std::cerr << "the render server only listens on unix sockets and loopback addresses like localhost:port, not "
+			<< address << std::endl;
+		return false;
+	}
+
+	std::string socketPath;
+	int listener = listenOn(address, socketPath);
+	if (listener < 0)
+		return false;
+	bool isUnix = !socketPath.empty();
+
+	std::cout << "Serving render requests at " << address << std::endl;
+
+	std::vector<int> clients;
+	bool quit = false;
+
+	while (!quit) {
+		std::vector<pollfd> fds(clients.size() + 1);
+		fds[0] = { listener, POLLIN, 0 };
+		for (size_t i=0; i < clients.size(); i++)
+			fds[i+1] = { clients[i], POLLIN, 0 };
+
+		if (poll(fds.data(), fds.size(), -1) < 0)
+			continue; // interrupted
+
+		for (size_t i = clients.size(); i-- > 0 && !quit; ) {
+			if (!(fds[i+1].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+
+			// a request line is sent at once, a client that stalls in the
+			// middle of one only holds up the others for so long
+			std::string line;
+			bool connected = receiveLine(clients[i], line, MAX_REQUEST_LINE);
+			if (connected && line == "quit" && !isUnix)
+				connected = sendLine(clients[i], "error quit is only taken on a unix socket");
+			else if (connected && line == "quit")
+				quit = true;
+			else if (connected && !line.empty())
+				connected = serveRequest(clients[i], line, defaults, render, threadCount);
+
+			if (!connected) {
+				close(clients[i]);
+				clients.erase(clients.begin() + i);
+			}
+		}
+
+		if (fds[0].revents & POLLIN) {
+			int client = accept(listener, NULL, NULL);
+			if (client >= 0) {
+				setReceiveTimeout(client, 10.0f);
+				clients.push_back(client);
+			}
+		}
+	}
+
+	for (int client: clients)
+		close(client);
+	close(listener);
+	if (!socketPath.empty())
+		unlink(socketPath.c_str());
+	return true;
+}
+
+
+bool sendRenderRequest(const std::string& address, const std::string& line, const std::string& filename) {
+
+	int s = connectTo(address);
+	if (s < 0) {
+		std::cerr << "no render server at " << address << std::endl;
+		return false;
+	}
+
+	std::string reply;
+	if (line == "quit") {
+		// the server hangs up once it got it
+		bool ok = sendLine(s, line) && !receiveLine(s, reply);
+		close(s);
+		if (ok)
+			std::cout << "The render server stopped." << std::endl;
+		else if (!reply.empty())
+			std::cerr << "render server: " << reply << std::endl;
+		return ok;
+	}
+
+	if (!sendLine(s, line) || !receiveLine(s, reply)) {
+		std::cerr << "the render server hung up" << std::endl;
+		close(s);
+		return false;
+	}
+
+	size_t bytes = 0;
+	double milliseconds = 0.0;
+	if (sscanf(reply.c_str(), "ok %zu %lf", &bytes, &milliseconds) != 2) {
+		std::cerr << "render server: " << reply << std::endl;
+		close(s);
+		return false;
+	}
+
+	std::vector<char> encoded(bytes);
+	bool ok = receiveAll(s, encoded.data(), bytes);
+	close(s);
+
+	if (!ok) {
+		std::cerr << "the render server hung up" << std::endl;
+		return false;
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.write(encoded.data(), bytes).good()) {
+		std::cerr << "couldn't write " + filename << std::endl;
+		return false;
+	}
+	std::cout << "Rendered image to a " + filename + " file in " << milliseconds << " ms. (SUCCESS)" << std::endl;
+	return true;
+}
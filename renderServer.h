@@ -0,0 +1,67 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "vectormath.h"
+#include "image.h"
+#include "imageFormats.h"
+
+
+// A daemon that keeps the scene with its BVHs and lights in memory and
+// renders it on request, so previews of the same scene from many
+// viewpoints don't pay for the startup every time. Clients connect to a
+// socket (see sockets.h) and send one request per line, key=value pairs
+// separated by spaces, all of them optional:
+//
+//   width=640 height=360 camera=-5,1,0 target=0,1,0 up=0,1,0 fov=45
+//   samples=4 time=0.5 format=png
+//
+// Keys left out have the value the server was started with. The reply is
+// a line "ok <bytes> <milliseconds>" followed by the image encoded in
+// format. Anything wrong gives a line "error <reason>". A line "quit" on
+// a unix socket stops the server.
+//
+// A request may have at most MAX_REQUEST_PIXELS pixels and
+// MAX_REQUEST_SAMPLES samples over all of them, request lines may be
+// MAX_REQUEST_LINE bytes long, a client sending a longer one is dropped.
+//
+// Clients aren't authenticated, so the server only listens on unix
+// sockets and loopback TCP addresses, e.g. "localhost:7000". Several
+// clients can be connected, their requests are rendered one at a time
+// with all render threads.
+
+
+const int MAX_REQUEST_SIZE = 16384;               // per side
+const long long MAX_REQUEST_PIXELS = 1 << 24;     // 200 MB of colors
+const long long MAX_REQUEST_SAMPLES = 1LL << 30;  // pixels * samples
+const size_t MAX_REQUEST_LINE = 4096;
+
+
+struct RenderRequest {
+	int width, height;
+	Point cameraPosition, cameraTarget;
+	Vector cameraUp;
+	float fov;          // vertical, in degrees
+	int samples;        // at most per pixel, 1 = no anti-aliasing
+	float time;         // moves the animation there, < 0 is the scene at rest
+	ImageFormat format; // of the image sent back
+};
+
+// overrides what the keys in line set, false with a reason for keys and
+// values it doesn't understand and requests over the limits above
+bool parseRenderRequest(const std::string& line, RenderRequest& request, std::string& error);
+
+
+// renders request into image, which has its size
+typedef std::function<bool(const RenderRequest& request, Image& image)> RequestRenderer;
+
+// serves requests at address until one says quit, false if it couldn't
+// listen or address isn't local (see isLocalAddress()). Requests start
+// from defaults.
+bool runRenderServer(const std::string& address, const RenderRequest& defaults,
+	const RequestRenderer& render, int threadCount = 0);
+
+// client side: sends one request line and writes the image that comes
+// back to filename, false with a message on cerr if that didn't work
+bool sendRenderRequest(const std::string& address, const std::string& line, const std::string& filename);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "sampler.h"
+
+// knobs of the renderer that don't belong to the scene
+struct RenderSettings {
+	int threadCount; // 0 = one per hardware thread
+	int tileSize;    // edge length of the square tiles handed to the threads
+	bool usePackets; // trace camera rays in SIMD packets, see rayPacket.h
+	bool wavefront;  // stage by stage over queues of rays instead of recursion, see wavefront.h
+	int bandRows;    // > 0 renders bands of that many rows straight to the file, see streamRender.h
+
+	// adaptive anti-aliasing, see rayTraceAdaptive(). maxSamples 1 traces a
+	// single ray through the corner of every pixel.
+	int minSamples;     // samples every pixel starts with
+	int maxSamples;     // budget of a pixel
+	float aaThreshold;  // color difference that makes a pixel worth refining
+	SamplerType sampler; // where in the pixel the samples go, see sampler.h
+
+	// when reflected and refracted rays stop, see rayWeight()
+	int maxDepth;         // bounces after the camera ray
+	float minThroughput;  // rays scaled by less on the way to the camera aren't traced, 0 = all
+	bool russianRoulette; // trace some of those at random instead, scaled up to make up for the rest
+
+	bool denoise; // filter the noise of few samples per pixel away, see denoise.h
+
+	RenderSettings() {
+		threadCount = 0;
+		tileSize = 32;
+		usePackets = true;
+		wavefront = false;
+		bandRows = 0;
+		minSamples = 1;
+		maxSamples = 1;
+		aaThreshold = 0.05f;
+		sampler = SAMPLER_SOBOL;
+		maxDepth = 3;
+		minThroughput = 0.0f;
+		russianRoulette = false;
+		denoise = false;
+	}
+};
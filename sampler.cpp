@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "sampler.h"
+
+
+// integer hash with good avalanche (from Chris Wellons' hash prospector)
+static unsigned int hash(unsigned int x) {
+
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+static unsigned int hash(unsigned int a, unsigned int b) {
+	return hash(a ^ hash(b + 0x9e3779b9u));
+}
+
+// seed of the stream of one pixel and dimension
+static unsigned int pixelSeed(int x, int y, int dimension, unsigned int seed) {
+	return hash(hash(hash(x, y), dimension), seed);
+}
+
+// the upper 24 bits as a float in [0, 1), so it never rounds up to 1
+static float toFloat(unsigned int x) {
+	return (x >> 8) * (1.0f / (1 << 24));
+}
+
+static float fract(float f) {
+	return f - std::floor(f);
+}
+
+
+
+Vector2 RandomSampler::get2D(int x, int y, int index, int dimension) const {
+
+	unsigned int h = hash(pixelSeed(x, y, dimension, seed), index);
+	return Vector2(toFloat(h), toFloat(hash(h)));
+}
+
+
+
+// random permutation of [0, length) picked by p, i maps to its place in it
+// (Kensler, Correlated Multi-Jittered Sampling)
+static unsigned int permute(unsigned int i, unsigned int length, unsigned int p) {
+
+	unsigned int w = length - 1;
+	w |= w >> 1;
+	w |= w >> 2;
+	w |= w >> 4;
+	w |= w >> 8;
+	w |= w >> 16;
+
+	do {
+		i ^= p; i *= 0xe170893d;
+		i ^= p >> 16;
+		i ^= (i & w) >> 4;
+		i ^= p >> 8; i *= 0x0929eb3f;
+		i ^= p >> 23;
+		i ^= (i & w) >> 1; i *= 1 | p >> 27;
+		i *= 0x6935fa69;
+		i ^= (i & w) >> 11; i *= 0x74dcb303;
+		i ^= (i & w) >> 2; i *= 0x9e501cc3;
+		i ^= (i & w) >> 2; i *= 0xc860a3df;
+		i &= w;
+		i ^= i >> 5;
+	} while (i >= length);
+
+	return (i + p) % length;
+}
+
+
+StratifiedSampler::StratifiedSampler(int samplesPerPixel, unsigned int seed)
+	: Sampler(seed)
+{
+	gridSize = std::max(1, (int)std::ceil(std::sqrt((float)samplesPerPixel)));
+}
+
+
+Vector2 StratifiedSampler::get2D(int x, int y, int index, int dimension) const {
+
+	int cellCount = gridSize * gridSize;
+	unsigned int round = index / cellCount;
+	unsigned int s = hash(pixelSeed(x, y, dimension, seed), round);
+
+	// the cells are visited in a random order per pixel and round
+	int cell = permute(index % cellCount, cellCount, s);
+	unsigned int jitter = hash(s, cell);
+
+	return Vector2((cell % gridSize + toFloat(jitter)) / gridSize,
+		(cell / gridSize + toFloat(hash(jitter))) / gridSize);
+}
+
+
+
+static unsigned int reverseBits(unsigned int x) {
+
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+	x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	return x;
+}
+
+// first two dimensions of the Sobol sequence, together a (0,2) sequence:
+// every power of two prefix has one point in each of the elementary intervals
+static unsigned int sobol(unsigned int index, int dimension) {
+
+	if (dimension == 0)
+		return reverseBits(index);
+
+	unsigned int result = 0;
+	for (unsigned int v = 1u << 31; index; index >>= 1, v ^= v >> 1) {
+		if (index & 1)
+			result ^= v;
+	}
+	return result;
+}
+
+// Owen scrambling with a hash, which keeps the (0,2) property and makes
+// the error fall off faster than the plain sequence (Burley, Practical
+// Hash-based Owen Scrambling)
+static unsigned int nestedUniformScramble(unsigned int x, unsigned int seed) {
+
+	x = reverseBits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverseBits(x);
+}
+
+// point index of a sequence shuffled and scrambled by seed
+static Vector2 scrambledSobol(unsigned int index, unsigned int seed) {
+
+	unsigned int i = nestedUniformScramble(index, seed);
+	return Vector2(toFloat(nestedUniformScramble(sobol(i, 0), hash(seed, 1))),
+		toFloat(nestedUniformScramble(sobol(i, 1), hash(seed, 2))));
+}
+
+
+Vector2 SobolSampler::get2D(int x, int y, int index, int dimension) const {
+	return scrambledSobol(index, pixelSeed(x, y, dimension, seed));
+}
+
+
+
+BlueNoiseSampler::BlueNoiseSampler(unsigned int seed)
+	: Sampler(seed), mask(&getBlueNoiseMask())
+{
+}
+
+
+Vector2 BlueNoiseSampler::get2D(int x, int y, int index, int dimension) const {
+
+	// same sequence for every pixel of a dimension, the mask decorrelates
+	unsigned int s = hash(hash(dimension), seed);
+	Vector2 point = scrambledSobol(index, s);
+
+	// the two coordinates read the mask at unrelated places, which moves
+	// with the dimension so dimensions don't share their offsets
+	int mx = x + (s & 63), my = y + ((s >> 6) & 63);
+	float du = (*mask)[(mx % BLUE_NOISE_SIZE) + (my % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE];
+	mx += BLUE_NOISE_SIZE / 2 + 7;
+	my += BLUE_NOISE_SIZE / 2 + 3;
+	float dv = (*mask)[(mx % BLUE_NOISE_SIZE) + (my % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE];
+
+	return Vector2(fract(point.u + du), fract(point.v + dv));
+}
+
+
+
+// void and cluster (Ulichney): points are put where the Gaussian filtered
+// pattern is emptiest, and the order they are put in is the mask value
+static std::vector<float> makeBlueNoiseMask() {
+
+	const int size = BLUE_NOISE_SIZE;
+	const int count = size * size;
+	const float sigma = 1.5f;
+
+	// filter weight for every toroidal offset
+	std::vector<float> kernel(count);
+	for (int dy=0; dy < size; dy++) {
+		for (int dx=0; dx < size; dx++) {
+			int wx = std::min(dx, size - dx), wy = std::min(dy, size - dy);
+			kernel[dx + dy * size] = std::exp(-(wx*wx + wy*wy) / (2.0f * sigma * sigma));
+		}
+	}
+
+	std::vector<char> pattern(count, 0);
+	std::vector<float> energy(count, 0.0f);
+
+	auto toggle = [&](std::vector<char>& points, std::vector<float>& field, int p, bool on) {
+		points[p] = on;
+		float sign = on ? 1.0f : -1.0f;
+		int px = p % size, py = p / size;
+		for (int y=0; y < size; y++) {
+			const float* row = &kernel[((y - py + size) % size) * size];
+			for (int x=0; x < size; x++)
+				field[x + y * size] += sign * row[(x - px + size) % size];
+		}
+	};
+
+	// tightest cluster: the set point with the most energy, largest void:
+	// the free point with the least
+	auto find = [&](const std::vector<char>& points, const std::vector<float>& field, bool cluster) {
+		int best = -1;
+		for (int p=0; p < count; p++) {
+			if (points[p] != cluster)
+				continue;
+			if (best < 0 || (cluster ? field[p] > field[best] : field[p] < field[best]))
+				best = p;
+		}
+		return best;
+	};
+
+	// a tenth of the points at random, then moved until evenly spread
+	int initialCount = count / 10;
+	for (unsigned int i=0; initialCount > 0; i++) {
+		int p = hash(i) % count;
+		if (!pattern[p]) {
+			toggle(pattern, energy, p, true);
+			initialCount--;
+		}
+	}
+
+	for (int iteration=0; iteration < count; iteration++) {
+		int cluster = find(pattern, energy, true);
+		toggle(pattern, energy, cluster, false);
+		int gap = find(pattern, energy, false);
+		toggle(pattern, energy, gap, true);
+		if (gap == cluster)
+			break;
+	}
+
+	std::vector<int> rank(count);
+	int ones = 0;
+	for (int p=0; p < count; p++)
+		ones += pattern[p];
+
+	// the initial points get the lowest ranks, tightest cluster last
+	std::vector<char> points = pattern;
+	std::vector<float> field = energy;
+	for (int r = ones - 1; r >= 0; r--) {
+		int cluster = find(points, field, true);
+		toggle(points, field, cluster, false);
+		rank[cluster] = r;
+	}
+
+	// the others in the order they fill the largest voids
+	for (int r = ones; r < count; r++) {
+		int gap = find(pattern, energy, false);
+		toggle(pattern, energy, gap, true);
+		rank[gap] = r;
+	}
+
+	std::vector<float> mask(count);
+	for (int p=0; p < count; p++)
+		mask[p] = (rank[p] + 0.5f) / count;
+
+	return mask;
+}
+
+
+const std::vector<float>& getBlueNoiseMask() {
+
+	static const std::vector<float> mask = makeBlueNoiseMask();
+	return mask;
+}
+
+
+
+std::unique_ptr<Sampler> makeSampler(SamplerType type, int samplesPerPixel, unsigned int seed) {
+
+	switch (type) {
+	case SAMPLER_RANDOM:
+		return std::unique_ptr<Sampler>(new RandomSampler(seed));
+	case SAMPLER_STRATIFIED:
+		return std::unique_ptr<Sampler>(new StratifiedSampler(samplesPerPixel, seed));
+	case SAMPLER_BLUE_NOISE:
+		return std::unique_ptr<Sampler>(new BlueNoiseSampler(seed));
+	case SAMPLER_SOBOL:
+	default:
+		return std::unique_ptr<Sampler>(new SobolSampler(seed));
+	}
+}
+
+
+bool parseSamplerType(const std::string& name, SamplerType& type) {
+
+	if (name == "random")
+		type = SAMPLER_RANDOM;
+	else if (name == "stratified")
+		type = SAMPLER_STRATIFIED;
+	else if (name == "sobol")
+		type = SAMPLER_SOBOL;
+	else if (name == "bluenoise")
+		type = SAMPLER_BLUE_NOISE;
+	else
+		return false;
+
+	return true;
+}
+
+
+float hashToFloat(const float values[], int count, unsigned int seed) {
+
+	unsigned int h = hash(seed);
+	for (int i=0; i < count; i++) {
+		unsigned int bits;
+		memcpy(&bits, &values[i], sizeof(bits));
+		h = hash(h, bits);
+	}
+	return toFloat(h);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "vectormath.h"
+
+
+enum SamplerType {
+	SAMPLER_RANDOM,     // independent uniform samples, the baseline
+	SAMPLER_STRATIFIED, // one jittered sample per cell of a sqrt(n) x sqrt(n) grid
+	SAMPLER_SOBOL,      // Owen scrambled Sobol (0,2) sequence
+	SAMPLER_BLUE_NOISE  // Sobol points shifted per pixel by a blue noise mask
+};
+
+
+// Samples in [0, 1) for everything that integrates over a pixel, e.g. the
+// position within the pixel for anti-aliasing. A sample only depends on
+// (pixel, index, dimension) and never on what was asked before, so a render
+// gives the same image no matter which thread or machine traces a tile
+// and in which order. Every pixel gets its own decorrelated stream, and
+// each dimension (a 2D pair: 0 = position in the pixel, others for future
+// effects like light or lens positions) is decorrelated from the others.
+class Sampler {
+protected:
+	unsigned int seed;
+
+public:
+	Sampler(unsigned int seed = 0) : seed(seed) {}
+
+	virtual ~Sampler() {}
+
+	// sample index of the stream of pixel (x, y) for the given dimension
+	virtual Vector2 get2D(int x, int y, int index, int dimension) const = 0;
+
+	virtual float get1D(int x, int y, int index, int dimension) const {
+		return get2D(x, y, index, dimension).u;
+	}
+};
+
+
+class RandomSampler : public Sampler {
+public:
+	RandomSampler(unsigned int seed = 0) : Sampler(seed) {}
+
+	virtual Vector2 get2D(int x, int y, int index, int dimension) const;
+};
+
+
+// the strata only cover the pixel evenly once all samplesPerPixel samples
+// are taken, indices past that start another round of strata
+class StratifiedSampler : public Sampler {
+protected:
+	int gridSize; // cells per side
+
+public:
+	StratifiedSampler(int samplesPerPixel, unsigned int seed = 0);
+
+	virtual Vector2 get2D(int x, int y, int index, int dimension) const;
+};
+
+
+// every prefix of the sequence is well distributed, so it suits adaptive
+// sampling where the sample count of a pixel isn't known in advance
+class SobolSampler : public Sampler {
+public:
+	SobolSampler(unsigned int seed = 0) : Sampler(seed) {}
+
+	virtual Vector2 get2D(int x, int y, int index, int dimension) const;
+};
+
+
+// All pixels share one scrambled Sobol sequence, offset (modulo 1) by the
+// values of a blue noise mask. Neighbouring pixels then get very different
+// offsets, which turns the error at low sample counts into high frequency
+// noise the eye barely notices instead of blotches.
+class BlueNoiseSampler : public Sampler {
+protected:
+	const std::vector<float>* mask; // BLUE_NOISE_SIZE^2 values in [0, 1)
+
+public:
+	BlueNoiseSampler(unsigned int seed = 0);
+
+	virtual Vector2 get2D(int x, int y, int index, int dimension) const;
+};
+
+
+// edge length of the tiled blue noise mask
+const int BLUE_NOISE_SIZE = 64;
+
+// blue noise threshold mask made with the void and cluster method, computed
+// on first use (a fraction of a second) and shared afterwards
+const std::vector<float>& getBlueNoiseMask();
+
+
+std::unique_ptr<Sampler> makeSampler(SamplerType type, int samplesPerPixel, unsigned int seed = 0);
+
+// "random", "stratified", "sobol" or "bluenoise", false for anything else
+bool parseSamplerType(const std::string& name, SamplerType& type);
+
+
+// uniform in [0, 1) from the bits of count values, for random decisions
+// made where no pixel and sample index are at hand, e.g. per ray. Like the
+// samplers it gives the same for the same input on any thread.
+float hashToFloat(const float values[], int count, unsigned int seed = 0);
@@ -0,0 +1,416 @@
+#include "scene.h"
+#include "primitives.h"
+#include "stats.h"
+#include "trace.h"
+
+
+Scene::Scene()
+	: builtCost(0.0f), hasRestPose(false)
+{
+}
+
+Scene::~Scene() {
+
+}
+
+
+int Scene::addMaterial(const MaterialProperty& material) {
+
+	materials.push_back(material);
+	return materials.size() - 1;
+}
+
+
+void Scene::addSphere(const Point& center, float radius, int material) {
+
+	SceneSphere sphere;
+	sphere.center = center;
+	sphere.radius = radius;
+
+	primitives.push_back({ PRIMITIVE_SPHERE, (int)spheres.size(), material });
+	spheres.push_back(sphere);
+	if (hasRestPose)
+		restSpheres.push_back(sphere);
+}
+
+
+void Scene::addPlane(const Point& position, const Vector& normal, int material) {
+
+	ScenePlane plane;
+	plane.position = position;
+	plane.normal = normal;
+
+	primitives.push_back({ PRIMITIVE_PLANE, (int)planes.size(), material });
+	planes.push_back(plane);
+	if (hasRestPose)
+		restPlanes.push_back(plane);
+}
+
+
+void Scene::addTriangle(const Point& A, const Point& B, const Point& C, int material) {
+
+	SceneTriangle triangle;
+	triangle.A = A;
+	triangle.B = B;
+	triangle.C = C;
+	triangle.normal = cross(C-B, A-B);
+	triangle.normal.normalize();
+
+	primitives.push_back({ PRIMITIVE_TRIANGLE, (int)triangles.size(), material });
+	triangles.push_back(triangle);
+	if (hasRestPose)
+		restTriangles.push_back(triangle);
+}
+
+
+void Scene::addCustomShape(Shape* shape) {
+
+	primitives.push_back({ PRIMITIVE_CUSTOM, (int)customShapes.size(), -1 });
+	customShapes.push_back(shape);
+}
+
+
+int Scene::addShape(Shape* shape) {
+
+	int first = primitives.size();
+	shape->addToScene(*this);
+	return first;
+}
+
+
+bool Scene::getPrimitiveBox(int id, BoundingBox& box) const {
+
+	const ScenePrimitive& primitive = primitives[id];
+	box = BoundingBox();
+
+	switch (primitive.type) {
+	case PRIMITIVE_SPHERE: {
+		const SceneSphere& sphere = spheres[primitive.index];
+		box = BoundingBox(sphere.center - Vector(sphere.radius), sphere.center + Vector(sphere.radius));
+		return true;
+	}
+	case PRIMITIVE_TRIANGLE: {
+		const SceneTriangle& triangle = triangles[primitive.index];
+		box.extend(triangle.A);
+		box.extend(triangle.B);
+		box.extend(triangle.C);
+		return true;
+	}
+	case PRIMITIVE_PLANE:
+		return false;
+	case PRIMITIVE_CUSTOM:
+		return customShapes[primitive.index]->getBoundingBox(box);
+	}
+
+	return false;
+}
+
+
+void Scene::build() {
+
+	TRACE_SCOPE("scene build");
+
+	boundedPrimitives.clear();
+	unboundedPrimitives.clear();
+
+	std::vector<BoundingBox> boxes;
+	for (int id=0; id < (int)primitives.size(); id++) {
+		BoundingBox box;
+
+		if (getPrimitiveBox(id, box)) {
+			boundedPrimitives.push_back(id);
+			boxes.push_back(box);
+		}
+		else {
+			unboundedPrimitives.push_back(id);
+		}
+	}
+
+	bvh.build(boxes);
+	builtCost = bvh.getCost();
+}
+
+
+void Scene::setPrimitiveTransform(int id, const Transform& transform) {
+
+	// the first move keeps the scene as it was added to start from
+	if (!hasRestPose) {
+		restSpheres = spheres;
+		restPlanes = planes;
+		restTriangles = triangles;
+		hasRestPose = true;
+	}
+
+	const ScenePrimitive& primitive = primitives[id];
+
+	switch (primitive.type) {
+	case PRIMITIVE_SPHERE: {
+		// stays a sphere, so only the scale along x counts
+		const SceneSphere& rest = restSpheres[primitive.index];
+		SceneSphere& sphere = spheres[primitive.index];
+		sphere.center = transform.applyPoint(rest.center);
+		sphere.radius = rest.radius * transform.applyVector(Vector(1.0f, 0.0f, 0.0f)).length();
+		break;
+	}
+	case PRIMITIVE_PLANE: {
+		const ScenePlane& rest = restPlanes[primitive.index];
+		ScenePlane& plane = planes[primitive.index];
+		plane.position = transform.applyPoint(rest.position);
+		plane.normal = transform.inverse().applyTransposed(rest.normal).normalized();
+		break;
+	}
+	case PRIMITIVE_TRIANGLE: {
+		const SceneTriangle& rest = restTriangles[primitive.index];
+		SceneTriangle& triangle = triangles[primitive.index];
+		triangle.A = transform.applyPoint(rest.A);
+		triangle.B = transform.applyPoint(rest.B);
+		triangle.C = transform.applyPoint(rest.C);
+		triangle.normal = cross(triangle.C - triangle.B, triangle.A - triangle.B);
+		triangle.normal.normalize();
+		break;
+	}
+	case PRIMITIVE_CUSTOM:
+		break; // moves itself, e.g. MeshInstance::setTransform()
+	}
+}
+
+
+bool Scene::update() {
+
+	TRACE_SCOPE("scene update");
+
+	std::vector<BoundingBox> boxes(boundedPrimitives.size());
+	for (size_t i=0; i < boundedPrimitives.size(); i++) {
+		// something lost its bounds, the split into bounded and not is off
+		if (!getPrimitiveBox(boundedPrimitives[i], boxes[i])) {
+			build();
+			return true;
+		}
+	}
+
+	bvh.refit(boxes);
+
+	if (bvh.getCost() > builtCost * SCENE_REBUILD_COST_RATIO) {
+		build();
+		return true;
+	}
+
+	return false;
+}
+
+
+inline bool Scene::intersectPrimitiveRay(const ScenePrimitive& primitive,
+	const Ray& ray, float tMax, float& t) const {
+
+	switch (primitive.type) {
+	case PRIMITIVE_SPHERE: {
+		STATS_COUNT(STAT_SPHERE_TESTS);
+		const SceneSphere& sphere = spheres[primitive.index];
+		return intersectSphereRay(sphere.center, sphere.radius, ray, tMax, t);
+	}
+	case PRIMITIVE_PLANE: {
+		STATS_COUNT(STAT_PLANE_TESTS);
+		const ScenePlane& plane = planes[primitive.index];
+		return intersectPlaneRay(plane.position, plane.normal, ray, tMax, t);
+	}
+	case PRIMITIVE_TRIANGLE: {
+		STATS_COUNT(STAT_TRIANGLE_TESTS);
+		const SceneTriangle& triangle = triangles[primitive.index];
+		return intersectTriangleRay(triangle.A, triangle.B, triangle.C, triangle.B,
+			triangle.normal, ray, tMax, t);
+	}
+	default:
+		return false;
+	}
+}
+
+
+inline bool Scene::intersectPrimitive(int id, Intersection& intersection) {
+
+	const ScenePrimitive& primitive = primitives[id];
+
+	// fills in the intersection itself
+	if (primitive.type == PRIMITIVE_CUSTOM)
+		return customShapes[primitive.index]->intersect(intersection);
+
+	float t;
+	if (!intersectPrimitiveRay(primitive, intersection.ray, intersection.t, t))
+		return false;
+
+	intersection.t = t;
+	intersection.pShape = this;
+	intersection.primitiveId = id;
+	intersection.color = materials[primitive.material].surfaceColor;
+
+	return true;
+}
+
+
+inline bool Scene::doesIntersectPrimitive(int id, const Ray& ray) {
+
+	const ScenePrimitive& primitive = primitives[id];
+
+	if (primitive.type == PRIMITIVE_CUSTOM)
+		return customShapes[primitive.index]->doesIntersect(ray);
+
+	float t;
+	return intersectPrimitiveRay(primitive, ray, ray.tMax, t);
+}
+
+
+inline bool Scene::occludedPrimitive(int id, const Ray& ray, const MaterialProperty*& lens) {
+
+	const ScenePrimitive& primitive = primitives[id];
+
+	if (primitive.type == PRIMITIVE_CUSTOM)
+		return customShapes[primitive.index]->occluded(ray, ray.tMax, lens);
+
+	float t;
+	if (!intersectPrimitiveRay(primitive, ray, ray.tMax, t))
+		return false;
+
+	const MaterialProperty& material = materials[primitive.material];
+	if (material.transparency > 0.0f) {
+		lens = &material;
+		return false;
+	}
+
+	return true;
+}
+
+
+inline void Scene::intersectPrimitivePacket(int id, RayPacket& packet) {
+
+	const ScenePrimitive& primitive = primitives[id];
+	int hits = 0;
+
+	switch (primitive.type) {
+	case PRIMITIVE_SPHERE: {
+		const SceneSphere& sphere = spheres[primitive.index];
+		hits = intersectSpherePacket(packet, sphere.center, sphere.radius);
+		STATS_ADD(STAT_SPHERE_TESTS, __builtin_popcount(packet.activeMask));
+		break;
+	}
+	case PRIMITIVE_PLANE: {
+		const ScenePlane& plane = planes[primitive.index];
+		hits = intersectPlanePacket(packet, plane.position, plane.normal);
+		STATS_ADD(STAT_PLANE_TESTS, __builtin_popcount(packet.activeMask));
+		break;
+	}
+	case PRIMITIVE_TRIANGLE: {
+		const SceneTriangle& triangle = triangles[primitive.index];
+		hits = intersectTrianglePacket(packet, triangle.A, triangle.B, triangle.C,
+			triangle.B, triangle.normal);
+		STATS_ADD(STAT_TRIANGLE_TESTS, __builtin_popcount(packet.activeMask));
+		break;
+	}
+	case PRIMITIVE_CUSTOM:
+		customShapes[primitive.index]->intersectPacket(packet);
+		return;
+	}
+
+	if (hits)
+		packet.record(hits, this, materials[primitive.material].surfaceColor, id);
+}
+
+
+bool Scene::intersect(Intersection& intersection) {
+
+	bool intersects = false;
+
+	for (int id: unboundedPrimitives) {
+		if (intersectPrimitive(id, intersection))
+			intersects = true;
+	}
+
+	if (bvh.intersect(intersection, [this](int i, Intersection& intersection) {
+			return intersectPrimitive(boundedPrimitives[i], intersection);
+		}))
+		intersects = true;
+
+	return intersects;
+}
+
+
+bool Scene::doesIntersect(const Ray& ray) {
+
+	for (int id: unboundedPrimitives) {
+		if (doesIntersectPrimitive(id, ray))
+			return true;
+	}
+
+	return bvh.doesIntersect(ray, [this](int i, const Ray& ray) {
+		return doesIntersectPrimitive(boundedPrimitives[i], ray);
+	});
+}
+
+
+bool Scene::occluded(const Ray& ray, float maxDistance, const MaterialProperty*& lens) {
+
+	Ray bounded(ray.origin, ray.direction, maxDistance);
+
+	for (int id: unboundedPrimitives) {
+		if (occludedPrimitive(id, bounded, lens))
+			return true;
+	}
+
+	// the bound on the ray lets the traversal skip every node past the light
+	return bvh.doesIntersect(bounded, [this, &lens](int i, const Ray& ray) {
+		return occludedPrimitive(boundedPrimitives[i], ray, lens);
+	});
+}
+
+
+void Scene::intersectPacket(RayPacket& packet) {
+
+	for (int id: unboundedPrimitives)
+		intersectPrimitivePacket(id, packet);
+
+	bvh.intersectPacket(packet, [this](int i, RayPacket& packet) {
+		intersectPrimitivePacket(boundedPrimitives[i], packet);
+	});
+}
+
+
+Vector Scene::getNormalVector(const Intersection& intersection) {
+
+	const ScenePrimitive& primitive = primitives[intersection.primitiveId];
+	Point hitPoint = intersection.position();
+	Vector normal;
+
+	// the same normals Sphere and Plane/Triangle give
+	switch (primitive.type) {
+	case PRIMITIVE_SPHERE:
+		normal = hitPoint - spheres[primitive.index].center;
+		break;
+	case PRIMITIVE_PLANE:
+		normal = hitPoint + planes[primitive.index].normal;
+		break;
+	case PRIMITIVE_TRIANGLE:
+		normal = hitPoint + triangles[primitive.index].normal;
+		break;
+	case PRIMITIVE_CUSTOM:
+		return Vector(); // hits on custom shapes point at the shape itself
+	}
+
+	return normal.normalized();
+}
+
+
+const MaterialProperty& Scene::getMaterialProperty(const Intersection& intersection) {
+
+	const ScenePrimitive& primitive = primitives[intersection.primitiveId];
+	if (primitive.material < 0)
+		return defaultMaterial;
+	return materials[primitive.material];
+}
+
+
+bool Scene::getBoundingBox(BoundingBox& box) {
+
+	if (!unboundedPrimitives.empty())
+		return false;
+
+	box = bvh.getBounds();
+	return !bvh.isEmpty();
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+
+#include "vectormath.h"
+#include "color.h"
+#include "ray.h"
+#include "rayPacket.h"
+#include "shape.h"
+#include "bvh.h"
+#include "transform.h"
+
+
+// the tag traversal switches on instead of going through a vtable
+enum PrimitiveType {
+	PRIMITIVE_SPHERE,
+	PRIMITIVE_PLANE,
+	PRIMITIVE_TRIANGLE,
+	PRIMITIVE_CUSTOM // any other Shape, e.g. a mesh, still called virtually
+};
+
+
+// update() rebuilds the BVH once refitting made it this much more expensive
+// to traverse than right after the last build
+const float SCENE_REBUILD_COST_RATIO = 1.5f;
+
+
+struct ScenePrimitive {
+	PrimitiveType type;
+	int index;    // into the array of its type
+	int material; // into the material table, -1 for custom shapes
+};
+
+
+struct SceneSphere {
+	Point center;
+	float radius;
+};
+
+struct ScenePlane {
+	Point position;
+	Vector normal;
+};
+
+struct SceneTriangle {
+	Point A, B, C; // counter clockwise, B is also the point on the plane
+	Vector normal;
+};
+
+
+// The scene compiled into one flat array per primitive type plus a table
+// of materials the primitives refer to by index. addShape() copies the
+// built in shapes in, so only custom shapes have to outlive the scene.
+// A hit on a built in primitive has pShape pointing at the scene and
+// primitiveId at the primitive, normal and material are looked up from it.
+class Scene : public Shape {
+protected:
+	std::vector<MaterialProperty> materials;
+	std::vector<SceneSphere> spheres;
+	std::vector<ScenePlane> planes;
+	std::vector<SceneTriangle> triangles;
+	std::vector<Shape*> customShapes;
+
+	std::vector<ScenePrimitive> primitives;
+	std::vector<int> boundedPrimitives;   // primitive of every BVH entry
+	std::vector<int> unboundedPrimitives; // planes and such, tested linearly
+	BVH bvh;
+	float builtCost; // of the BVH when it was built, see update()
+
+	// the built in primitives as they were added. The first
+	// setPrimitiveTransform() makes the copy, primitives added after it go
+	// into both.
+	bool hasRestPose;
+	std::vector<SceneSphere> restSpheres;
+	std::vector<ScenePlane> restPlanes;
+	std::vector<SceneTriangle> restTriangles;
+
+	MaterialProperty defaultMaterial;
+
+	// the built in types, t is the nearest hit in (RAY_T_MIN, tMax)
+	inline bool intersectPrimitiveRay(const ScenePrimitive& primitive,
+		const Ray& ray, float tMax, float& t) const;
+
+	inline bool intersectPrimitive(int id, Intersection& intersection);
+	inline bool doesIntersectPrimitive(int id, const Ray& ray);
+	inline bool occludedPrimitive(int id, const Ray& ray, const MaterialProperty*& lens);
+	inline void intersectPrimitivePacket(int id, RayPacket& packet);
+
+public:
+	Scene();
+
+	virtual ~Scene();
+
+	// returns the index the primitives refer to the material by
+	int addMaterial(const MaterialProperty& material);
+
+	void addSphere(const Point& center, float radius, int material);
+	void addPlane(const Point& position, const Vector& normal, int material);
+	void addTriangle(const Point& A, const Point& B, const Point& C, int material);
+
+	// kept by pointer and intersected through its virtual functions
+	void addCustomShape(Shape* shape);
+
+	// lets the shape add itself, see Shape::addToScene(). Returns the id of
+	// the first primitive it added, the others follow.
+	int addShape(Shape* shape);
+
+	// has to be called after the last add and before rendering
+	void build();
+
+	// moves a built in primitive by transform, from where it was added.
+	// Spheres only take the scale along x. Custom shapes move themselves.
+	void setPrimitiveTransform(int id, const Transform& transform);
+
+	// after primitives moved: refits the BVH to them, and rebuilds it when
+	// that made it SCENE_REBUILD_COST_RATIO times as costly as the last
+	// build. Returns true if it rebuilt.
+	bool update();
+
+	// world box of a primitive, false for unbounded ones like planes
+	bool getPrimitiveBox(int id, BoundingBox& box) const;
+
+	const MaterialProperty& getMaterial(int material) const { return materials[material]; }
+	int getPrimitiveCount() const { return primitives.size(); }
+
+	virtual bool intersect(Intersection& intersection);
+	virtual bool doesIntersect(const Ray& ray);
+	virtual Vector getNormalVector(const Point& pHit) { return Vector(); } // needs the primitive
+	virtual Vector getNormalVector(const Intersection& intersection);
+	virtual const MaterialProperty& getMaterialProperty() { return defaultMaterial; }
+	virtual const MaterialProperty& getMaterialProperty(const Intersection& intersection);
+	virtual bool getBoundingBox(BoundingBox& box);
+	virtual void intersectPacket(RayPacket& packet);
+	virtual bool occluded(const Ray& ray, float maxDistance, const MaterialProperty*& lens);
+};
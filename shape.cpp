@@ -1,9 +1,63 @@
+#include <algorithm>
 #include <cmath>
 
 #include "shape.h"
+#include "scene.h"
+#include "primitives.h"
 #include "vectormath.h"
 
 
+MaterialProperty::MaterialProperty(const Color& surfaceColor,
+		const float reflection,
+		const float transparency,
+		const float refractiveIndex,
+		const Color& emissionColor):
+			surfaceColor(surfaceColor),
+			emissionColor(emissionColor),
+			refractiveIndex(refractiveIndex)
+{
+	this->transparency = std::max(0.0f, std::min(transparency, 1.0f)); // between 0 and 1
+	this->reflection = std::max(0.0f, std::min(reflection, 1.0f)); // between 0 and 1
+}
+
+
+
+void Shape::intersectPacket(RayPacket& packet) {
+
+	for (int i=0; i < PACKET_SIZE; i++) {
+		if (!(packet.activeMask & (1 << i)))
+			continue;
+
+		Intersection intersection = packet.getIntersection(i);
+		if (intersect(intersection)) {
+			packet.t[i] = intersection.t;
+			packet.record(1 << i, intersection.pShape, intersection.color, intersection.primitiveId);
+		}
+	}
+}
+
+
+bool Shape::occluded(const Ray& ray, float maxDistance, const MaterialProperty*& lens) {
+
+	Ray bounded(ray.origin, ray.direction, maxDistance);
+	if (!doesIntersect(bounded))
+		return false;
+
+	const MaterialProperty& material = getMaterialProperty();
+	if (material.transparency > 0.0f) {
+		lens = &material;
+		return false;
+	}
+
+	return true;
+}
+
+
+void Shape::addToScene(Scene& scene) {
+	scene.addCustomShape(this);
+}
+
+
 ShapeSet::ShapeSet() {
 
 }
@@ -42,6 +96,47 @@ bool ShapeSet::doesIntersect(const Ray& ray) {
 }
 
 
+void ShapeSet::intersectPacket(RayPacket& packet) {
+
+	for (const auto& shape: shapes)
+		shape->intersectPacket(packet);
+}
+
+
+bool ShapeSet::occluded(const Ray& ray, float maxDistance, const MaterialProperty*& lens) {
+
+	for (const auto& shape: shapes) {
+		if (shape->occluded(ray, maxDistance, lens))
+			return true;
+	}
+
+	return false;
+}
+
+
+void ShapeSet::addToScene(Scene& scene) {
+
+	// flattened into the scene, the set itself isn't traced
+	for (const auto& shape: shapes)
+		shape->addToScene(scene);
+}
+
+
+bool ShapeSet::getBoundingBox(BoundingBox& box) {
+
+	// bounded only if every member is
+	box = BoundingBox();
+	for (const auto& shape: shapes) {
+		BoundingBox shapeBox;
+		if (!shape->getBoundingBox(shapeBox))
+			return false;
+		box.extend(shapeBox);
+	}
+
+	return !shapes.empty();
+}
+
+
 Plane::Plane(const Point& position, const Vector& normal,
 		const Color& surfaceColor,
 		const float reflection,
@@ -50,12 +145,8 @@ Plane::Plane(const Point& position, const Vector& normal,
 		const Color& emissionColor):
 			position(position),
 			normal(normal),
-			surfaceColor(surfaceColor),
-			refractiveIndex(refractiveIndex),
-			emissionColor(emissionColor)
+			material(surfaceColor, reflection, transparency, refractiveIndex, emissionColor)
 {
-	this->transparency = std::max(0.0f, std::min(transparency, 1.0f)); // between 0 and 1
-	this->reflection = std::max(0.0f, std::min(reflection, 1.0f)); // between 0 and 1
 }
 
 Plane::~Plane()
@@ -70,40 +161,20 @@ Vector Plane::getNormalVector(const Point& pHit) {
 }
 
 
-MaterialProperty Plane::getMaterialProperty() {
-	MaterialProperty mp;
-	mp.surfaceColor = surfaceColor;
-	mp.emissionColor = emissionColor;
-	mp.transparency = transparency;
-	mp.refractiveIndex = refractiveIndex;
-	mp.reflection = reflection;
-	return mp;
+const MaterialProperty& Plane::getMaterialProperty() {
+	return material;
 }
 
 
 bool Plane::intersect(Intersection& intersection) {
 
-	// First, check if we intersect
-	float dDotN = dot(intersection.ray.direction, normal);
-
-	if (dDotN == 0.0f)
-	{
-		// We just assume the ray is not embedded in the plane
+	float t;
+	if (!intersectPlaneRay(position, normal, intersection.ray, intersection.t, t))
 		return false;
-	}
-
-	// Find point of intersection
-	float t = dot(position - intersection.ray.origin, normal) / dDotN;
-
-	if (t <= RAY_T_MIN || t >= intersection.t)
-	{
-		// Outside relevant range
-		return false;
-	}
 
 	intersection.t = t;
 	intersection.pShape = this;
-	intersection.color = surfaceColor;
+	intersection.color = material.surfaceColor;
 
 	return true;
 
@@ -111,26 +182,20 @@ bool Plane::intersect(Intersection& intersection) {
 
 bool Plane::doesIntersect(const Ray& ray) {
 
-	// First, check if we intersect
-	float dDotN = dot(ray.direction, normal);
+	float t;
+	return intersectPlaneRay(position, normal, ray, ray.tMax, t);
+}
 
-	if (dDotN == 0.0f)
-	{
-		// We just assume the ray is not embedded in the plane
-		return false;
-	}
 
-	// Find point of intersection
-	float t = dot(position - ray.origin, normal) / dDotN;
+void Plane::intersectPacket(RayPacket& packet) {
 
-	if (t <= RAY_T_MIN || t >= ray.tMax)
-	{
-		// Outside relevant range
-		return false;
-	}
+	int hits = intersectPlanePacket(packet, position, normal);
+	packet.record(hits, this, material.surfaceColor);
+}
 
-	return true;
 
+void Plane::addToScene(Scene& scene) {
+	scene.addPlane(position, normal, scene.addMaterial(material));
 }
 
 
@@ -140,13 +205,9 @@ Triangle::Triangle (const Point vertices[],
 		const float reflection,
 		const float transparency,
 		const float refractiveIndex,
-		const Color& emissionColor):
-			surfaceColor(surfaceColor),
-			refractiveIndex(refractiveIndex),
-			emissionColor(emissionColor)
+		const Color& emissionColor)
 {
-	this->transparency = std::max(0.0f, std::min(transparency, 1.0f)); // between 0 and 1
-	this->reflection = std::max(0.0f, std::min(reflection, 1.0f)); // between 0 and 1
+	material = MaterialProperty(surfaceColor, reflection, transparency, refractiveIndex, emissionColor);
 
 	A = vertices[0];
 	B = vertices[1];
@@ -163,79 +224,44 @@ Triangle::Triangle (const Point vertices[],
 
 bool Triangle::intersect(Intersection& intersection) {
 
-	// First, check if we intersect
-	float dDotN = dot(intersection.ray.direction, normal);
-
-	if (dDotN == 0.0f)
-	{
-		// We just assume the ray is not embedded in the plane
+	float t;
+	if (!intersectTriangleRay(A, B, C, position, normal, intersection.ray, intersection.t, t))
 		return false;
-	}
-
-	// Find point of intersection
-	float t = dot(position - intersection.ray.origin, normal) / dDotN;
-
-	if (t <= RAY_T_MIN || t >= intersection.t)
-	{
-		// Outside relevant range
-		return false;
-	}
-
-	Point Q = intersection.ray.calculate(t);
 
-	// by looking at the sign of the the cross product we can identify
-	// if the point lies to the left or right of the vector
-	// so checking where Q lies relative to the edges of the triangle
-	// we can verify whether Q lies inside the triangle
+	intersection.t = t;
+	intersection.pShape = this;
+	intersection.color = material.surfaceColor;
 
-	if ( dot( cross(C-B, Q-B), normal ) >= 0 &&
-		 dot( cross(A-C, Q-C), normal ) >= 0 &&
-		 dot( cross(B-A, Q-A), normal ) >= 0) 
-	{
-		// Q lies inside the triangle ABC
+	return true;
+}
 
-		intersection.t = t;
-		intersection.pShape = this;
-		intersection.color = surfaceColor;
 
-		return true;	
-	}
+bool Triangle::doesIntersect(const Ray& ray) {
 
-	return false;
+	float t;
+	return intersectTriangleRay(A, B, C, position, normal, ray, ray.tMax, t);
 }
 
 
-bool Triangle::doesIntersect(const Ray& ray) {
-
-// First, check if we intersect
-	float dDotN = dot(ray.direction, normal);
+bool Triangle::getBoundingBox(BoundingBox& box) {
 
-	if (dDotN == 0.0f)
-	{
-		// We just assume the ray is not embedded in the plane
-		return false;
-	}
+	box = BoundingBox();
+	box.extend(A);
+	box.extend(B);
+	box.extend(C);
+	return true;
+}
 
-	// Find point of intersection
-	float t = dot(position - ray.origin, normal) / dDotN;
 
-	if (t <= RAY_T_MIN || t >= ray.tMax)
-	{
-		// Outside relevant range
-		return false;
-	}
+void Triangle::intersectPacket(RayPacket& packet) {
 
-	Point Q = ray.calculate(t);
+	int hits = intersectTrianglePacket(packet, A, B, C, position, normal);
+	packet.record(hits, this, material.surfaceColor);
+}
 
-	if ( dot( cross(C-B, Q-B), normal ) >= 0 &&
-		 dot( cross(A-C, Q-C), normal ) >= 0 &&
-		 dot( cross(B-A, Q-A), normal ) >= 0) 
-	{
-		// Q lies inside the triangle ABC
-		return true;	
-	}
 
-	return false;
+void Triangle::addToScene(Scene& scene) {
+	scene.addTriangle(A, B, C, scene.addMaterial(material));
 }
 
 
@@ -248,12 +274,8 @@ Sphere::Sphere(const Point& center, float radius,
 	const Color& emissionColor):
 		center(center),
 		radius(radius),
-		surfaceColor(surfaceColor),
-		refractiveIndex(refractiveIndex),
-		emissionColor(emissionColor)
+		material(surfaceColor, reflection, transparency, refractiveIndex, emissionColor)
 {
-	this->transparency = std::max(0.0f, std::min(transparency, 1.0f)); // between 0 and 1
-	this->reflection = std::max(0.0f, std::min(reflection, 1.0f)); // between 0 and 1
 }
 
 Sphere::~Sphere()
@@ -268,56 +290,22 @@ Vector Sphere::getNormalVector(const Point& pHit) {
 }
 
 
-MaterialProperty Sphere::getMaterialProperty() {
-	MaterialProperty mp;
-	mp.surfaceColor = surfaceColor;
-	mp.emissionColor = emissionColor;
-	mp.transparency = transparency;
-	mp.refractiveIndex = refractiveIndex;
-	mp.reflection = reflection;
-	return mp;
+const MaterialProperty& Sphere::getMaterialProperty() {
+	return material;
 }
 
 
 
 bool Sphere::intersect(Intersection& intersection) {
 
-	// bring sphere at the origin first
-	Ray newRay = intersection.ray;
-	newRay.origin -= center;
-
-	// quadratic coefficients
-	float a = dot(newRay.direction, newRay.direction);
-	float b = 2 * dot(newRay.origin, newRay.direction);
-	float c = dot(newRay.origin, newRay.origin) - radius*radius;
-
-	// check if we intersect
-	float discriminant = b*b - 4*a*c;
-
-	if (discriminant < 0.0f)
-		return false;
-
-	if (2*a == 0.0f) 
-		return false; // infinite solution
-
-	// two points of intersections, t0 <= t1
-	float t0 = (-b - sqrt(discriminant)) / 2*a;
-	float t1 = (-b + sqrt(discriminant)) / 2*a;
-
-	// first check if smaller t is valid
-	if (t0 > RAY_T_MIN && t0 < intersection.t) {
-		intersection.t = t0;
-	}
-	else if (t1 > RAY_T_MIN && t1 < intersection.t) {
-		intersection.t = t1;
-	}
-	else {
+	float t;
+	if (!intersectSphereRay(center, radius, intersection.ray, intersection.t, t))
 		return false;
-	}
 
 	// finish populating intersection
+	intersection.t = t;
 	intersection.pShape = this;
-	intersection.color = surfaceColor;
+	intersection.color = material.surfaceColor;
 
 	return true;
 
@@ -326,34 +314,25 @@ bool Sphere::intersect(Intersection& intersection) {
 
 bool Sphere::doesIntersect(const Ray& ray) {
 
-	// bring sphere at the origin first
-	Ray newRay = ray;
-	newRay.origin -= center;
-
-	// quadratic coefficients
-	float a = dot(newRay.direction, newRay.direction);
-	float b = 2 * dot(newRay.origin, newRay.direction);
-	float c = dot(newRay.origin, newRay.origin) - radius*radius;
+	float t;
+	return intersectSphereRay(center, radius, ray, ray.tMax, t);
+}
 
-	// check if we intersect
-	float discriminant = b*b - 4*a*c;
 
-	if (discriminant < 0.0f)
-		return false;
+bool Sphere::getBoundingBox(BoundingBox& box) {
 
-	if (2*a == 0.0f) 
-		return false; // infinite solution
+	box = BoundingBox(center - Vector(radius), center + Vector(radius));
+	return true;
+}
 
-	// two points of intersections, t0 <= t1
-	float t0 = (-b - sqrt(discriminant)) / 2*a;
-	float t1 = (-b + sqrt(discriminant)) / 2*a;
 
-	if (t0 > RAY_T_MIN && t0 < ray.tMax)
-		return true;
+void Sphere::intersectPacket(RayPacket& packet) {
 
-	if (t1 > RAY_T_MIN && t1 < ray.tMax)
-		return true;
+	int hits = intersectSpherePacket(packet, center, radius);
+	packet.record(hits, this, material.surfaceColor);
+}
 
-	return false;
 
-}
\ No newline at end of file
+void Sphere::addToScene(Scene& scene) {
+	scene.addSphere(center, radius, scene.addMaterial(material));
+}
@@ -5,11 +5,23 @@
 #include "vectormath.h"
 #include "color.h"
 #include "ray.h"
+#include "boundingBox.h"
+#include "rayPacket.h"
+
+class Scene;
 
 
 struct MaterialProperty {
 	Color surfaceColor, emissionColor;
 	float transparency, reflection, refractiveIndex;
+
+	// same defaults and order as the shape constructors, transparency and
+	// reflection are clamped to [0, 1]
+	MaterialProperty(const Color& surfaceColor = Color(1.0f, 1.0f, 1.0f),
+		const float reflection = 0.0f,
+		const float transparency = 0.0f,
+		const float refractiveIndex = 1.0f,
+		const Color& emissionColor = Color(0.0f));
 };
 
 
@@ -22,7 +34,35 @@ public:
 	virtual bool intersect(Intersection& intersection) = 0;
 	virtual bool doesIntersect(const Ray& ray) = 0;
 	virtual Vector getNormalVector(const Point& pHit) = 0;
-	virtual MaterialProperty getMaterialProperty() = 0;
+	virtual const MaterialProperty& getMaterialProperty() = 0;
+
+	// shapes made of many primitives (meshes) need intersection.primitiveId
+	// to tell the normal, everything else just looks at the hit point
+	virtual Vector getNormalVector(const Intersection& intersection) {
+		return getNormalVector(intersection.position());
+	}
+
+	// likewise for shapes whose primitives don't share one material
+	virtual const MaterialProperty& getMaterialProperty(const Intersection& intersection) {
+		return getMaterialProperty();
+	}
+
+	// shapes without a finite extent (planes) return false, acceleration
+	// structures keep those out of the hierarchy
+	virtual bool getBoundingBox(BoundingBox& box) { return false; }
+
+	// closest hit for every lane of the packet, shapes with a SIMD kernel
+	// override this, the default intersects the lanes one by one
+	virtual void intersectPacket(RayPacket& packet);
+
+	// shadow query: true as soon as an opaque shape lies within maxDistance
+	// along the ray, transparent ones don't block but their material is
+	// handed back in lens so the caller can treat them as a lens
+	virtual bool occluded(const Ray& ray, float maxDistance, const MaterialProperty*& lens);
+
+	// Scene::addShape() lets every shape put itself into the scene's flat
+	// arrays, shapes without such a representation are kept as they are
+	virtual void addToScene(Scene& scene);
 };
 
 
@@ -41,7 +81,14 @@ public:
 	virtual bool intersect(Intersection& intersection);
 	virtual bool doesIntersect(const Ray& ray);
 	virtual Vector getNormalVector(const Point& pHit) { return Vector();} // because they were pure
-	virtual MaterialProperty getMaterialProperty() { return MaterialProperty();} // virtual functions
+	virtual const MaterialProperty& getMaterialProperty() { return material;} // virtual functions
+	virtual bool getBoundingBox(BoundingBox& box);
+	virtual void intersectPacket(RayPacket& packet);
+	virtual bool occluded(const Ray& ray, float maxDistance, const MaterialProperty*& lens);
+	virtual void addToScene(Scene& scene);
+
+private:
+	MaterialProperty material;
 };
 
 
@@ -50,9 +97,7 @@ class Plane : public Shape
 protected:
 	Point position;
 	Vector normal;
-	Color surfaceColor, emissionColor;
-	float transparency, reflection; // from 0 and 1
-	float refractiveIndex;
+	MaterialProperty material;
 
 public:
 
@@ -68,9 +113,11 @@ public:
 	virtual ~Plane();
 
 	virtual Vector getNormalVector(const Point& pHit);
-	virtual MaterialProperty getMaterialProperty();
+	virtual const MaterialProperty& getMaterialProperty();
 	virtual bool intersect(Intersection& intersection);
 	virtual bool doesIntersect(const Ray& ray);
+	virtual void intersectPacket(RayPacket& packet);
+	virtual void addToScene(Scene& scene);
 };
 
 
@@ -78,12 +125,7 @@ public:
 class Triangle : public Plane {
 
 public:
-	Point A, B, C; // vertices in counter clockwise order
-	Point position;
-	Vector normal;
-	Color surfaceColor, emissionColor;
-	float transparency, reflection;
-	float refractiveIndex;
+	Point A, B, C; // vertices in counter clockwise order, position is B
 
 	Triangle (const Point vertices[], 
 		const Color& surfaceColor = Color(1.0f, 1.0f, 1.0f),
@@ -94,6 +136,9 @@ public:
 
 	bool intersect(Intersection& intersection);
 	bool doesIntersect(const Ray& ray);
+	bool getBoundingBox(BoundingBox& box);
+	void intersectPacket(RayPacket& packet);
+	void addToScene(Scene& scene);
 
 };
 
@@ -104,9 +149,7 @@ class Sphere : public Shape
 protected:
 	Point center;
 	float radius;
-	Color surfaceColor, emissionColor;      /// surface color and emission (light) 
-    float transparency, reflection;         /// surface transparency and reflectivity 
-    float refractiveIndex;					/// from the scale of 0 to 1
+	MaterialProperty material;
 
 public:
 	Sphere(const Point& center, float radius,
@@ -119,7 +162,10 @@ public:
 	virtual ~Sphere();
 
 	virtual Vector getNormalVector(const Point& pHit);
-	virtual MaterialProperty getMaterialProperty();
+	virtual const MaterialProperty& getMaterialProperty();
 	virtual bool intersect(Intersection& intersection);
 	virtual bool doesIntersect(const Ray& ray);
+	virtual bool getBoundingBox(BoundingBox& box);
+	virtual void intersectPacket(RayPacket& packet);
+	virtual void addToScene(Scene& scene);
 };
@@ -0,0 +1,183 @@
+#pragma once
+
+// 8 float lanes with the handful of operations the packet kernels need.
+// Backed by one AVX register, two SSE registers or a plain array depending
+// on what the translation unit is compiled for. With SSE4.1 the selects
+// are single blends instead of and/andnot/or. Only use these types inside
+// a single .cpp file, their layout changes with the compiler flags, and
+// within the namespace PACKET_KERNELS_ISA of that build.
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <cmath>
+#endif
+
+#ifndef PACKET_KERNELS_ISA
+#error "simd.h needs PACKET_KERNELS_ISA, the namespace of the build"
+#endif
+
+namespace PACKET_KERNELS_ISA {
+
+#if defined(__AVX__)
+
+struct vfloat8 {
+	__m256 v;
+
+	vfloat8() {}
+	vfloat8(__m256 v) : v(v) {}
+	explicit vfloat8(float f) : v(_mm256_set1_ps(f)) {}
+
+	static vfloat8 load(const float* p) { return _mm256_load_ps(p); }
+	void store(float* p) const { _mm256_store_ps(p, v); }
+};
+
+struct vbool8 {
+	__m256 v;
+
+	vbool8() {}
+	vbool8(__m256 v) : v(v) {}
+};
+
+inline vfloat8 operator +(vfloat8 a, vfloat8 b) { return _mm256_add_ps(a.v, b.v); }
+inline vfloat8 operator -(vfloat8 a, vfloat8 b) { return _mm256_sub_ps(a.v, b.v); }
+inline vfloat8 operator *(vfloat8 a, vfloat8 b) { return _mm256_mul_ps(a.v, b.v); }
+inline vfloat8 operator /(vfloat8 a, vfloat8 b) { return _mm256_div_ps(a.v, b.v); }
+inline vfloat8 operator -(vfloat8 a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+inline vfloat8 vsqrt(vfloat8 a) { return _mm256_sqrt_ps(a.v); }
+inline vfloat8 vmin(vfloat8 a, vfloat8 b) { return _mm256_min_ps(a.v, b.v); }
+inline vfloat8 vmax(vfloat8 a, vfloat8 b) { return _mm256_max_ps(a.v, b.v); }
+
+inline vbool8 operator <(vfloat8 a, vfloat8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline vbool8 operator <=(vfloat8 a, vfloat8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline vbool8 operator >(vfloat8 a, vfloat8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline vbool8 operator >=(vfloat8 a, vfloat8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline vbool8 operator !=(vfloat8 a, vfloat8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ); }
+
+inline vbool8 operator &(vbool8 a, vbool8 b) { return _mm256_and_ps(a.v, b.v); }
+inline vbool8 operator |(vbool8 a, vbool8 b) { return _mm256_or_ps(a.v, b.v); }
+
+// lane i of the result is a[i] where mask[i] is set, b[i] otherwise
+inline vfloat8 select(vbool8 mask, vfloat8 a, vfloat8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+inline int movemask(vbool8 mask) { return _mm256_movemask_ps(mask.v); }
+
+#elif defined(__SSE2__)
+
+struct vfloat8 {
+	__m128 lo, hi;
+
+	vfloat8() {}
+	vfloat8(__m128 lo, __m128 hi) : lo(lo), hi(hi) {}
+	explicit vfloat8(float f) : lo(_mm_set1_ps(f)), hi(_mm_set1_ps(f)) {}
+
+	static vfloat8 load(const float* p) { return vfloat8(_mm_load_ps(p), _mm_load_ps(p + 4)); }
+	void store(float* p) const { _mm_store_ps(p, lo); _mm_store_ps(p + 4, hi); }
+};
+
+struct vbool8 {
+	__m128 lo, hi;
+
+	vbool8() {}
+	vbool8(__m128 lo, __m128 hi) : lo(lo), hi(hi) {}
+};
+
+#define SIMD_SSE_OP(type, name, intrinsic) \
+	inline type name(vfloat8 a, vfloat8 b) { return type(intrinsic(a.lo, b.lo), intrinsic(a.hi, b.hi)); }
+
+SIMD_SSE_OP(vfloat8, operator +, _mm_add_ps)
+SIMD_SSE_OP(vfloat8, operator -, _mm_sub_ps)
+SIMD_SSE_OP(vfloat8, operator *, _mm_mul_ps)
+SIMD_SSE_OP(vfloat8, operator /, _mm_div_ps)
+SIMD_SSE_OP(vfloat8, vmin, _mm_min_ps)
+SIMD_SSE_OP(vfloat8, vmax, _mm_max_ps)
+SIMD_SSE_OP(vbool8, operator <, _mm_cmplt_ps)
+SIMD_SSE_OP(vbool8, operator <=, _mm_cmple_ps)
+SIMD_SSE_OP(vbool8, operator >, _mm_cmpgt_ps)
+SIMD_SSE_OP(vbool8, operator >=, _mm_cmpge_ps)
+SIMD_SSE_OP(vbool8, operator !=, _mm_cmpneq_ps)
+
+#undef SIMD_SSE_OP
+
+inline vfloat8 operator -(vfloat8 a) {
+	__m128 sign = _mm_set1_ps(-0.0f);
+	return vfloat8(_mm_xor_ps(a.lo, sign), _mm_xor_ps(a.hi, sign));
+}
+
+inline vfloat8 vsqrt(vfloat8 a) { return vfloat8(_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)); }
+
+inline vbool8 operator &(vbool8 a, vbool8 b) { return vbool8(_mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi)); }
+inline vbool8 operator |(vbool8 a, vbool8 b) { return vbool8(_mm_or_ps(a.lo, b.lo), _mm_or_ps(a.hi, b.hi)); }
+
+#if defined(__SSE4_1__)
+inline vfloat8 select(vbool8 mask, vfloat8 a, vfloat8 b) {
+	return vfloat8(_mm_blendv_ps(b.lo, a.lo, mask.lo), _mm_blendv_ps(b.hi, a.hi, mask.hi));
+}
+#else
+inline vfloat8 select(vbool8 mask, vfloat8 a, vfloat8 b) {
+	return vfloat8(_mm_or_ps(_mm_and_ps(mask.lo, a.lo), _mm_andnot_ps(mask.lo, b.lo)),
+		_mm_or_ps(_mm_and_ps(mask.hi, a.hi), _mm_andnot_ps(mask.hi, b.hi)));
+}
+#endif
+
+inline int movemask(vbool8 mask) { return _mm_movemask_ps(mask.lo) | (_mm_movemask_ps(mask.hi) << 4); }
+
+#else
+
+struct vfloat8 {
+	float v[8];
+
+	vfloat8() {}
+	explicit vfloat8(float f) { for (int i=0; i < 8; i++) v[i] = f; }
+
+	static vfloat8 load(const float* p) { vfloat8 r; for (int i=0; i < 8; i++) r.v[i] = p[i]; return r; }
+	void store(float* p) const { for (int i=0; i < 8; i++) p[i] = v[i]; }
+};
+
+struct vbool8 {
+	bool v[8];
+};
+
+#define SIMD_SCALAR_OP(type, name, expr) \
+	inline type name(vfloat8 a, vfloat8 b) { type r; for (int i=0; i < 8; i++) r.v[i] = (expr); return r; }
+
+SIMD_SCALAR_OP(vfloat8, operator +, a.v[i] + b.v[i])
+SIMD_SCALAR_OP(vfloat8, operator -, a.v[i] - b.v[i])
+SIMD_SCALAR_OP(vfloat8, operator *, a.v[i] * b.v[i])
+SIMD_SCALAR_OP(vfloat8, operator /, a.v[i] / b.v[i])
+SIMD_SCALAR_OP(vfloat8, vmin, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+SIMD_SCALAR_OP(vfloat8, vmax, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+SIMD_SCALAR_OP(vbool8, operator <, a.v[i] < b.v[i])
+SIMD_SCALAR_OP(vbool8, operator <=, a.v[i] <= b.v[i])
+SIMD_SCALAR_OP(vbool8, operator >, a.v[i] > b.v[i])
+SIMD_SCALAR_OP(vbool8, operator >=, a.v[i] >= b.v[i])
+SIMD_SCALAR_OP(vbool8, operator !=, a.v[i] != b.v[i])
+
+#undef SIMD_SCALAR_OP
+
+inline vfloat8 operator -(vfloat8 a) { vfloat8 r; for (int i=0; i < 8; i++) r.v[i] = -a.v[i]; return r; }
+inline vfloat8 vsqrt(vfloat8 a) { vfloat8 r; for (int i=0; i < 8; i++) r.v[i] = std::sqrt(a.v[i]); return r; }
+
+inline vbool8 operator &(vbool8 a, vbool8 b) { vbool8 r; for (int i=0; i < 8; i++) r.v[i] = a.v[i] && b.v[i]; return r; }
+inline vbool8 operator |(vbool8 a, vbool8 b) { vbool8 r; for (int i=0; i < 8; i++) r.v[i] = a.v[i] || b.v[i]; return r; }
+
+inline vfloat8 select(vbool8 mask, vfloat8 a, vfloat8 b) {
+	vfloat8 r;
+	for (int i=0; i < 8; i++)
+		r.v[i] = mask.v[i] ? a.v[i] : b.v[i];
+	return r;
+}
+
+inline int movemask(vbool8 mask) {
+	int bits = 0;
+	for (int i=0; i < 8; i++)
+		bits |= mask.v[i] << i;
+	return bits;
+}
+
+#endif
+
+} // namespace PACKET_KERNELS_ISA
@@ -0,0 +1,243 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "sockets.h"
+
+
+bool sendAll(int socket, const void* data, size_t size) {
+
+	const char* bytes = (const char*)data;
+	while (size > 0) {
+		// a peer that went away must not kill the process with SIGPIPE
+		ssize_t sent = send(socket, bytes, size, MSG_NOSIGNAL);
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+
+bool receiveAll(int socket, void* data, size_t size) {
+
+	char* bytes = (char*)data;
+	while (size > 0) {
+		ssize_t received = recv(socket, bytes, size, 0);
+		if (received <= 0)
+			return false;
+		bytes += received;
+		size -= received;
+	}
+	return true;
+}
+
+
+void setReceiveTimeout(int socket, float seconds) {
+
+	timeval tv;
+	tv.tv_sec = (long)seconds;
+	tv.tv_usec = (long)((seconds - tv.tv_sec) * 1e6f);
+	setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+
+// "unix:/path" or "host:port"
+static bool parseAddress(const std::string& address, bool& isUnix, std::string& host, std::string& port) {
+
+	isUnix = address.compare(0, 5, "unix:") == 0;
+	if (isUnix) {
+		host = address.substr(5);
+		return !host.empty() && host.size() < sizeof(sockaddr_un::sun_path);
+	}
+
+	size_t colon = address.find_last_of(':');
+	if (colon == std::string::npos || colon + 1 == address.size())
+		return false;
+	host = address.substr(0, colon);
+	port = address.substr(colon + 1);
+	return true;
+}
+
+
+static sockaddr_un makeUnixAddress(const std::string& path) {
+
+	sockaddr_un unixAddress;
+	memset(&unixAddress, 0, sizeof(unixAddress));
+	unixAddress.sun_family = AF_UNIX;
+	strncpy(unixAddress.sun_path, path.c_str(), sizeof(unixAddress.sun_path) - 1);
+	return unixAddress;
+}
+
+
+bool isLocalAddress(const std::string& address) {
+
+	bool isUnix;
+	std::string host, port;
+	if (!parseAddress(address, isUnix, host, port))
+		return false;
+	if (isUnix)
+		return true;
+	if (host.empty() || host == "*")
+		return false;
+
+	addrinfo hints, *results;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0)
+		return false;
+
+	bool local = true;
+	for (addrinfo* a = results; a; a = a->ai_next) {
+		if (a->ai_family == AF_INET)
+			local &= (ntohl(((sockaddr_in*)a->ai_addr)->sin_addr.s_addr) >> 24) == 127;
+		else if (a->ai_family == AF_INET6)
+			local &= IN6_IS_ADDR_LOOPBACK(&((sockaddr_in6*)a->ai_addr)->sin6_addr) != 0;
+		else
+			local = false;
+	}
+	freeaddrinfo(results);
+	return local;
+}
+
+
+int connectTo(const std::string& address) {
+
+	bool isUnix;
+	std::string host, port;
+	if (!parseAddress(address, isUnix, host, port))
+		return -1;
+
+	if (isUnix) {
+		int s = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un unixAddress = makeUnixAddress(host);
+		if (s >= 0 && connect(s, (sockaddr*)&unixAddress, sizeof(unixAddress)) == 0)
+			return s;
+		if (s >= 0)
+			close(s);
+		return -1;
+	}
+
+	addrinfo hints, *results;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0)
+		return -1;
+
+	int s = -1;
+	for (addrinfo* a = results; a && s < 0; a = a->ai_next) {
+		s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (s >= 0 && connect(s, a->ai_addr, a->ai_addrlen) != 0) {
+			close(s);
+			s = -1;
+		}
+	}
+	freeaddrinfo(results);
+
+	if (s >= 0) {
+		// small messages like headers shouldn't wait for more data
+		int one = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+	return s;
+}
+
+
+int listenOn(const std::string& address, std::string& socketPath) {
+
+	int listener = -1;
+	bool isUnix;
+	std::string host, port;
+	if (!parseAddress(address, isUnix, host, port)) {
+		std::cerr << "bad address " << address << ", expected unix:/path or host:port" << std::endl;
+		return -1;
+	}
+
+	if (isUnix) {
+		// a socket left over by an earlier run is replaced, anything else
+		// at the path is left alone
+		struct stat status;
+		if (lstat(host.c_str(), &status) == 0) {
+			if (!S_ISSOCK(status.st_mode)) {
+				std::cerr << "couldn't listen on " << address << ": " << host << " exists and isn't a socket" << std::endl;
+				return -1;
+			}
+			unlink(host.c_str());
+		}
+
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un unixAddress = makeUnixAddress(host);
+
+		if (listener < 0 || bind(listener, (sockaddr*)&unixAddress, sizeof(unixAddress)) != 0) {
+			std::cerr << "couldn't listen on " << address << ": " << strerror(errno) << std::endl;
+			if (listener >= 0)
+				close(listener);
+			return -1;
+		}
+		socketPath = host;
+	}
+	else {
+		addrinfo hints, *results;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_PASSIVE;
+		const char* node = (host.empty() || host == "*") ? NULL : host.c_str();
+		if (getaddrinfo(node, port.c_str(), &hints, &results) != 0) {
+			std::cerr << "couldn't resolve " << address << std::endl;
+			return -1;
+		}
+
+		for (addrinfo* a = results; a && listener < 0; a = a->ai_next) {
+			listener = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+			int one = 1;
+			if (listener >= 0)
+				setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			if (listener >= 0 && bind(listener, a->ai_addr, a->ai_addrlen) != 0) {
+				close(listener);
+				listener = -1;
+			}
+		}
+		freeaddrinfo(results);
+
+		if (listener < 0) {
+			std::cerr << "couldn't listen on " << address << ": " << strerror(errno) << std::endl;
+			return -1;
+		}
+	}
+
+	if (listen(listener, 64) != 0) {
+		std::cerr << "couldn't listen on " << address << ": " << strerror(errno) << std::endl;
+		close(listener);
+		return -1;
+	}
+	return listener;
+}
+
+
+bool receiveLine(int socket, std::string& line, size_t maxLength) {
+
+	line.clear();
+	char c;
+	while (receiveAll(socket, &c, 1)) {
+		if (c == '\n')
+			return true;
+		if (c != '\r')
+			line += c;
+		if (line.size() > maxLength)
+			return false;
+	}
+	return false;
+}
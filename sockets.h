@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+// Blocking stream sockets for the distributed renderer and the render
+// server. Addresses are "unix:/path/to/socket" or "host:port" for TCP,
+// listening on "*:port" takes every interface.
+
+
+// a listening socket, -1 with a message on cerr if that didn't work. For
+// a unix socket, socketPath is the file to unlink once done.
+int listenOn(const std::string& address, std::string& socketPath);
+
+// true for unix sockets and TCP addresses that only resolve to loopback
+// interfaces, i.e. ones nobody on another machine can connect to
+bool isLocalAddress(const std::string& address);
+
+// a connected socket, -1 if nobody listens at address
+int connectTo(const std::string& address);
+
+bool sendAll(int socket, const void* data, size_t size);
+
+// false on errors, timeouts and when the other side hung up
+bool receiveAll(int socket, void* data, size_t size);
+
+// up to the next newline, which isn't stored, nor are carriage returns.
+// False as well for lines longer than maxLength.
+bool receiveLine(int socket, std::string& line, size_t maxLength = 4096);
+
+// receives fail after seconds without data
+void setReceiveTimeout(int socket, float seconds);
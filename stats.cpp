@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <mutex>
+
+#include "stats.h"
+#include "image.h"
+
+#ifdef RENDER_STATS
+
+
+// blocks of the threads that ended
+static std::mutex totalsMutex;
+static RenderStats totals;
+
+
+RenderStats::RenderStats() {
+
+	for (int kind=0; kind < RAY_KIND_COUNT; kind++)
+		for (int depth=0; depth < STATS_MAX_DEPTH; depth++)
+			rays[kind][depth] = 0;
+
+	for (int counter=0; counter < STAT_COUNTER_COUNT; counter++)
+		counters[counter] = 0;
+}
+
+
+void RenderStats::add(const RenderStats& other) {
+
+	for (int kind=0; kind < RAY_KIND_COUNT; kind++)
+		for (int depth=0; depth < STATS_MAX_DEPTH; depth++)
+			rays[kind][depth] += other.rays[kind][depth];
+
+	for (int counter=0; counter < STAT_COUNTER_COUNT; counter++)
+		counters[counter] += other.counters[counter];
+
+	tileTimes.insert(tileTimes.end(), other.tileTimes.begin(), other.tileTimes.end());
+}
+
+
+ThreadStats::~ThreadStats() {
+
+	std::lock_guard<std::mutex> lock(totalsMutex);
+	totals.add(*this);
+}
+
+
+// the totals so far, including the calling thread which is still running
+static RenderStats collect() {
+
+	RenderStats stats;
+	{
+		std::lock_guard<std::mutex> lock(totalsMutex);
+		stats.add(totals);
+	}
+	stats.add(threadStats());
+	return stats;
+}
+
+
+static const char* rayKindNames[RAY_KIND_COUNT] = {
+	"camera", "shadow", "reflected", "refracted", "transmitted"
+};
+
+static const char* counterNames[STAT_COUNTER_COUNT] = {
+	"sphere_tests", "plane_tests", "triangle_tests", "mesh_triangle_tests",
+	"bvh_nodes", "bvh_packet_nodes", "total_internal_reflections"
+};
+
+
+bool writeStatsReport(const std::string& filename) {
+
+	RenderStats stats = collect();
+
+	FILE* file = fopen(filename.c_str(), "w");
+	if (!file)
+		return false;
+
+	long long totalRays = 0;
+	for (int kind=0; kind < RAY_KIND_COUNT; kind++)
+		for (int depth=0; depth < STATS_MAX_DEPTH; depth++)
+			totalRays += stats.rays[kind][depth];
+
+	fprintf(file, "{\n  \"rays\": {\n    \"total\": %lld,\n", totalRays);
+
+	// by kind, then by depth within the kind
+	for (int kind=0; kind < RAY_KIND_COUNT; kind++) {
+		long long sum = 0;
+		for (int depth=0; depth < STATS_MAX_DEPTH; depth++)
+			sum += stats.rays[kind][depth];
+
+		fprintf(file, "    \"%s\": { \"total\": %lld, \"by_depth\": [", rayKindNames[kind], sum);
+		for (int depth=0; depth < STATS_MAX_DEPTH; depth++)
+			fprintf(file, "%s%lld", depth ? ", " : "", stats.rays[kind][depth]);
+		fprintf(file, "] }%s\n", kind + 1 < RAY_KIND_COUNT ? "," : "");
+	}
+	fprintf(file, "  },\n");
+
+	for (int counter=0; counter < STAT_COUNTER_COUNT; counter++)
+		fprintf(file, "  \"%s\": %lld,\n", counterNames[counter], stats.counters[counter]);
+
+	double tileSeconds = 0.0, slowestTile = 0.0;
+	for (const auto& time: stats.tileTimes) {
+		tileSeconds += time.seconds;
+		slowestTile = std::max(slowestTile, time.seconds);
+	}
+	fprintf(file, "  \"tiles\": { \"count\": %d, \"seconds\": %.6f, \"slowest_seconds\": %.6f }\n}\n",
+		(int)stats.tileTimes.size(), tileSeconds, slowestTile);
+
+	return fclose(file) == 0;
+}
+
+
+bool writeTileHeatmap(const std::string& filename, int width, int height) {
+
+	RenderStats stats = collect();
+
+	// seconds per pixel, tiles of several passes over the same pixels add up
+	std::vector<float> cost((size_t)width * height, 0.0f);
+	for (const auto& time: stats.tileTimes) {
+		const Tile& tile = time.tile;
+		int area = (tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+		if (area <= 0 || tile.x1 > width || tile.y1 > height)
+			continue;
+
+		float perPixel = time.seconds / area;
+		for (int y = tile.y0; y < tile.y1; y++)
+			for (int x = tile.x0; x < tile.x1; x++)
+				cost[x + (size_t)y * width] += perPixel;
+	}
+
+	float maxCost = 0.0f;
+	for (float c: cost)
+		maxCost = std::max(maxCost, c);
+
+	// black -> red -> yellow -> white
+	Image image(width, height);
+	for (int y=0; y < height; y++) {
+		for (int x=0; x < width; x++) {
+			float f = maxCost > 0.0f ? 3.0f * cost[x + (size_t)y * width] / maxCost : 0.0f;
+			*image.getPixel(x, y) = Color(std::min(f, 1.0f),
+				std::min(std::max(f - 1.0f, 0.0f), 1.0f), std::min(std::max(f - 2.0f, 0.0f), 1.0f));
+		}
+	}
+
+	std::unique_ptr<ImageStream> stream = openImageStream(filename, getImageFormat(filename), width, height);
+	if (!stream)
+		return false;
+
+	std::vector<unsigned char> rgb((size_t)width * height * 3);
+	image.toRGB8(rgb.data());
+	return stream->writeRows(rgb.data(), height) && stream->close();
+}
+
+
+#endif
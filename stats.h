@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "tileScheduler.h"
+
+
+// Render statistics: rays by kind and depth, ray primitive tests by
+// primitive type, BVH nodes visited and tile timings. Only compiled in when
+// RENDER_STATS is defined (make STATS=1), otherwise the STATS_ macros are
+// empty and nothing of this is left in the renderer.
+//
+// Every thread counts into its own block, without locks or atomics. When
+// a thread ends its block is added to the totals, which are what
+// writeStatsReport() and writeTileHeatmap() read, so call them once the
+// render threads are done.
+
+
+// what a ray is traced for
+enum RayKind {
+	RAY_CAMERA,
+	RAY_SHADOW,
+	RAY_REFLECTED,
+	RAY_REFRACTED,
+	RAY_TRANSMITTED, // a shadow ray followed on through transparent shapes
+	RAY_KIND_COUNT
+};
+
+enum StatCounter {
+	STAT_SPHERE_TESTS,        // one per ray, packet lanes count one each
+	STAT_PLANE_TESTS,
+	STAT_TRIANGLE_TESTS,
+	STAT_MESH_TRIANGLE_TESTS,
+	STAT_BVH_NODES,           // visited by single rays
+	STAT_BVH_PACKET_NODES,    // visited by packets
+	STAT_TOTAL_INTERNAL_REFLECTIONS, // refract() found no refracted ray
+	STAT_COUNTER_COUNT
+};
+
+// deeper rays are counted as this depth - 1
+const int STATS_MAX_DEPTH = 8;
+
+
+struct TileTime {
+	Tile tile;
+	double seconds;
+};
+
+struct RenderStats {
+	long long rays[RAY_KIND_COUNT][STATS_MAX_DEPTH];
+	long long counters[STAT_COUNTER_COUNT];
+	std::vector<TileTime> tileTimes;
+
+	RenderStats();
+
+	void add(const RenderStats& other);
+};
+
+// the block of one thread, which adds itself to the totals when the thread ends
+struct ThreadStats : public RenderStats {
+	~ThreadStats();
+};
+
+// the block of the calling thread
+inline RenderStats& threadStats() {
+	static thread_local ThreadStats stats;
+	return stats;
+}
+
+
+// times the scope and books it for tile
+class TileTimer {
+protected:
+	Tile tile;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	TileTimer(const Tile& tile) : tile(tile), start(std::chrono::steady_clock::now()) {}
+
+	~TileTimer() {
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		threadStats().tileTimes.push_back({ tile, seconds });
+	}
+};
+
+
+// the counts of all threads as JSON, false if the file couldn't be written
+bool writeStatsReport(const std::string& filename);
+
+// an image of the time spent per pixel, from the tile timings of a
+// width x height frame. Black is no time, white the slowest tile.
+bool writeTileHeatmap(const std::string& filename, int width, int height);
+
+
+#ifdef RENDER_STATS
+#define STATS_COUNT(counter) (threadStats().counters[counter]++)
+#define STATS_ADD(counter, n) (threadStats().counters[counter] += (n))
+#define STATS_RAYS(kind, depth, n) (threadStats().rays[kind][std::min((int)(depth), STATS_MAX_DEPTH - 1)] += (n))
+#define STATS_RAY(kind, depth) STATS_RAYS(kind, depth, 1)
+#define STATS_TIME_TILE(tile) TileTimer tileTimer(tile)
+#else
+#define STATS_COUNT(counter) ((void)0)
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_RAYS(kind, depth, n) ((void)0)
+#define STATS_RAY(kind, depth) ((void)0)
+#define STATS_TIME_TILE(tile) ((void)0)
+#endif
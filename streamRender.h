@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rayTrace.h"
+#include "wavefront.h"
+#include "imageFormats.h"
+#include "trace.h"
+
+
+// Renders a width x height frame a band of settings.bandRows rows at a time
+// into one reused band Image and streams every band to filename as soon as
+// it is done, in the format its extension picks. Memory doesn't grow with
+// the resolution: a 32K x 32K poster needs a band of floats and its 8 bit
+// copy instead of 12 GB of framebuffer. The pixels are the same as when
+// rendering the whole frame at once. Returns the number of camera samples
+// traced, -1 if the file couldn't be written.
+long long rayTraceToFile(const std::string& filename, int width, int height,
+	Camera* camera, Shape* scene, const LightSet& lights, const RenderSettings& settings) {
+
+	// whole tiles per band, so the tiles are those of the whole frame
+	int tileSize = std::max(1, settings.tileSize);
+	int bandRows = std::max(1, (settings.bandRows + tileSize - 1) / tileSize) * tileSize;
+	bandRows = std::min(bandRows, height);
+
+	std::unique_ptr<ImageStream> stream = openImageStream(filename, getImageFormat(filename),
+		width, height, settings.threadCount);
+	if (!stream)
+		return -1;
+
+	Image band(width, height, bandRows);
+	std::vector<unsigned char> rgb((size_t)width * bandRows * 3);
+	long long samples = 0;
+
+	for (int y = 0; y < height; y += bandRows) {
+		TRACE_SCOPE("band");
+		band.setBand(y, std::min(bandRows, height - y));
+
+		if (settings.wavefront) {
+			rayTraceWavefront(band, camera, scene, lights, settings);
+			samples += (long long)width * band.getRowCount();
+		}
+		else
+			samples += rayTrace(band, camera, scene, lights, settings);
+
+		{
+			TRACE_SCOPE("convert to rgb8");
+			band.toRGB8(rgb.data());
+		}
+		if (!stream->writeRows(rgb.data(), band.getRowCount()))
+			return -1;
+	}
+
+	return stream->close() ? samples : -1;
+}
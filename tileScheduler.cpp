@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <thread>
+
+#include "tileScheduler.h"
+#include "stats.h"
+#include "trace.h"
+
+
+std::vector<Tile> makeTiles(int width, int height, int tileSize) {
+	return makeTiles(width, 0, height, tileSize);
+}
+
+
+std::vector<Tile> makeTiles(int width, int y0, int y1, int tileSize) {
+
+	std::vector<Tile> tiles;
+	tileSize = std::max(1, tileSize);
+
+	for (int y=y0; y < y1; y += tileSize) {
+		for (int x=0; x < width; x += tileSize) {
+			Tile tile;
+			tile.x0 = x;
+			tile.y0 = y;
+			tile.x1 = std::min(x + tileSize, width);
+			tile.y1 = std::min(y + tileSize, y1);
+			tiles.push_back(tile);
+		}
+	}
+
+	return tiles;
+}
+
+
+TileScheduler::TileScheduler(int threadCount) {
+
+	if (threadCount <= 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	this->threadCount = threadCount;
+	queues = std::vector<WorkQueue>(threadCount);
+}
+
+
+int TileScheduler::getThreadCount() const {
+	return threadCount;
+}
+
+
+bool TileScheduler::popOwn(int thread, int& tile) {
+
+	WorkQueue& queue = queues[thread];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	if (queue.tiles.empty())
+		return false;
+
+	tile = queue.tiles.front();
+	queue.tiles.pop_front();
+	return true;
+}
+
+
+bool TileScheduler::steal(int thread, int& tile) {
+
+	// try the neighbours in turn so that thieves spread over the victims
+	for (int i=1; i < threadCount; i++) {
+		WorkQueue& queue = queues[(thread + i) % threadCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (!queue.tiles.empty()) {
+			tile = queue.tiles.back();
+			queue.tiles.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void TileScheduler::run(const std::vector<Tile>& tiles,
+	const std::function<void(const Tile&, int)>& renderTile) {
+
+	// hand every thread a contiguous run of tiles, neighbouring tiles
+	// tend to touch the same part of the scene
+	int tileCount = tiles.size();
+	for (int thread=0; thread < threadCount; thread++) {
+		int first = (long long)tileCount * thread / threadCount;
+		int last = (long long)tileCount * (thread + 1) / threadCount;
+		for (int i = first; i < last; i++)
+			queues[thread].tiles.push_back(i);
+	}
+
+	// no tile creates new work, so a thread that finds every deque
+	// empty is done for good
+	auto work = [&](int thread) {
+		setTraceThread(thread);
+
+		int tile;
+		while (popOwn(thread, tile) || steal(thread, tile)) {
+			TraceScope traceTile(tiles[tile]);
+			STATS_TIME_TILE(tiles[tile]);
+			renderTile(tiles[tile], thread);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (int thread=1; thread < threadCount; thread++)
+		workers.push_back(std::thread(work, thread));
+
+	work(0);
+
+	for (auto& worker: workers)
+		worker.join();
+}
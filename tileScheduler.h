@@ -0,0 +1,50 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+// pixel rectangle [x0, x1) x [y0, y1)
+struct Tile {
+	int x0, y0, x1, y1;
+};
+
+// splits a width x height image into row major tiles of tileSize x tileSize,
+// the tiles on the right and bottom border may be smaller
+std::vector<Tile> makeTiles(int width, int height, int tileSize);
+
+// the same for the rows [y0, y1) only, e.g. the band an Image holds
+std::vector<Tile> makeTiles(int width, int y0, int y1, int tileSize);
+
+
+// Runs a function over a list of tiles on several threads. Every thread
+// owns a deque of tiles, works through it from the front and when it runs
+// dry steals from the back of another thread's deque. So cheap tiles (sky)
+// and expensive ones (glass) even out without a central queue everybody
+// fights over.
+class TileScheduler {
+protected:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<int> tiles;
+	};
+
+	int threadCount;
+	std::vector<WorkQueue> queues;
+
+	bool popOwn(int thread, int& tile);
+	bool steal(int thread, int& tile);
+
+public:
+	// threadCount <= 0 picks one thread per hardware thread
+	TileScheduler(int threadCount = 0);
+
+	int getThreadCount() const;
+
+	// calls renderTile(tile, threadIndex) once for every tile, the calling
+	// thread works as thread 0. Returns when all tiles are done.
+	void run(const std::vector<Tile>& tiles,
+		const std::function<void(const Tile&, int)>& renderTile);
+};
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "trace.h"
+
+
+bool traceEnabled = false;
+
+static std::string traceFilename;
+static std::chrono::steady_clock::time_point traceStart;
+
+
+struct TraceEvent {
+	const char* name;
+	double start, duration; // microseconds
+	Tile tile;
+	bool isTile;
+};
+
+// events of one thread, only ever touched by it until the trace is written
+struct TraceBuffer {
+	int row;
+	std::vector<TraceEvent> events;
+};
+
+// buffers outlive their threads, the workers of a TileScheduler only live
+// for one run()
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<TraceBuffer>> buffers;
+// rows of threads that never called setTraceThread(), after the workers
+const int TRACE_OTHER_ROWS = 1000;
+static int nextRow = TRACE_OTHER_ROWS;
+
+static thread_local TraceBuffer* threadBuffer = NULL;
+
+
+static TraceBuffer& getThreadBuffer() {
+
+	if (!threadBuffer) {
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		buffers.emplace_back(new TraceBuffer());
+		threadBuffer = buffers.back().get();
+		threadBuffer->row = nextRow++;
+		threadBuffer->events.reserve(1024);
+	}
+	return *threadBuffer;
+}
+
+
+double traceTime() {
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - traceStart).count();
+}
+
+
+void TraceScope::record() const {
+
+	double end = traceTime();
+	getThreadBuffer().events.push_back({ name, start, end - start, tile, isTile });
+}
+
+
+void setTraceThread(int row) {
+
+	if (traceEnabled)
+		getThreadBuffer().row = row;
+}
+
+
+static void writeTrace() {
+
+	FILE* file = fopen(traceFilename.c_str(), "w");
+	if (!file) {
+		std::cerr << "couldn't write the trace to " + traceFilename << std::endl;
+		return;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+	// names for the rows, buffers of the workers of successive runs share them
+	std::vector<int> named;
+	bool first = true;
+	for (const auto& buffer: buffers) {
+		if (std::find(named.begin(), named.end(), buffer->row) != named.end())
+			continue;
+		named.push_back(buffer->row);
+
+		char name[32];
+		if (buffer->row == 0)
+			snprintf(name, sizeof(name), "main, worker 0");
+		else if (buffer->row < TRACE_OTHER_ROWS)
+			snprintf(name, sizeof(name), "worker %d", buffer->row);
+		else
+			snprintf(name, sizeof(name), "thread %d", buffer->row - TRACE_OTHER_ROWS);
+		fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+			first ? "" : ",\n", buffer->row, name);
+		first = false;
+	}
+
+	for (const auto& buffer: buffers) {
+		for (const auto& event: buffer->events) {
+			fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+				first ? "" : ",\n", event.name, buffer->row, event.start, event.duration);
+			if (event.isTile)
+				fprintf(file, ", \"args\": {\"x0\": %d, \"y0\": %d, \"x1\": %d, \"y1\": %d}",
+					event.tile.x0, event.tile.y0, event.tile.x1, event.tile.y1);
+			fprintf(file, "}");
+			first = false;
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+
+	if (fclose(file) == 0)
+		std::cout << "Wrote the trace to " + traceFilename << std::endl;
+	else
+		std::cerr << "couldn't write the trace to " + traceFilename << std::endl;
+}
+
+
+void startTrace(const std::string& filename) {
+
+	if (traceEnabled)
+		return;
+
+	traceFilename = filename;
+	traceStart = std::chrono::steady_clock::now();
+	traceEnabled = true;
+	std::atexit(writeTrace);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+
+#include "tileScheduler.h"
+
+
+// Timeline of a run as Chrome trace events, for chrome://tracing or
+// ui.perfetto.dev. Scopes like parsing, BVH builds, every tile and the
+// image encoding are recorded as events with their start and duration on
+// the thread that ran them, so idle threads, stragglers and serial phases
+// show up as gaps.
+//
+// Off unless startTrace() was called, a scope then costs one branch. Each
+// thread appends to its own buffer without any locking, only its first
+// event takes a lock to register the buffer. The file is written at exit.
+
+
+// starts recording, the events go to filename when the program ends
+void startTrace(const std::string& filename);
+
+// the row the calling thread's events appear in, e.g. the worker index of
+// a TileScheduler. Threads that don't call it get a row of their own.
+void setTraceThread(int row);
+
+
+// set by startTrace(), before any thread is started
+extern bool traceEnabled;
+
+// microseconds since startTrace()
+double traceTime();
+
+
+// records the time from construction to destruction as an event
+class TraceScope {
+protected:
+	const char* name; // not copied, a literal
+	Tile tile;
+	bool isTile;
+	double start; // < 0 if tracing was off
+
+	void record() const;
+
+public:
+	TraceScope(const char* name)
+		: name(name), isTile(false), start(traceEnabled ? traceTime() : -1.0) {}
+
+	// "tile", with the corners as arguments
+	TraceScope(const Tile& tile)
+		: name("tile"), tile(tile), isTile(true), start(traceEnabled ? traceTime() : -1.0) {}
+
+	~TraceScope() {
+		if (start >= 0.0)
+			record();
+	}
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cmath>
+
+#include "vectormath.h"
+
+// Affine transform: a 3x3 linear part and a translation in the last
+// column, the implicit 4th row is (0 0 0 1). Header only and trivially
+// copyable like the rest of the math, see vectormath.h.
+
+struct Transform
+{
+	float m[3][4] = { { 1.0f, 0.0f, 0.0f, 0.0f },
+	                  { 0.0f, 1.0f, 0.0f, 0.0f },
+	                  { 0.0f, 0.0f, 1.0f, 0.0f } }; // default is the identity
+
+	constexpr Transform() {}
+
+	static inline Transform translation(const Vector& offset);
+	static inline Transform scaling(const Vector& factors);
+	static inline Transform scaling(float factor) { return scaling(Vector(factor)); }
+
+	// counter clockwise by angle (radians) looking down the axis
+	static inline Transform rotation(const Vector& axis, float angle);
+
+	constexpr Point applyPoint(const Point& p) const
+	{
+		return Point(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+			m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+			m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+	}
+
+	// directions ignore the translation
+	constexpr Vector applyVector(const Vector& v) const
+	{
+		return Vector(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+			m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+			m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+	}
+
+	// the linear part transposed. Normals are transformed by the inverse
+	// transposed, so called on the inverse this maps normals forward.
+	constexpr Vector applyTransposed(const Vector& v) const
+	{
+		return Vector(m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+			m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+			m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z);
+	}
+
+	inline Transform inverse() const;
+};
+
+
+// a * b applies b first, then a
+inline Transform operator *(const Transform& a, const Transform& b)
+{
+	Transform result;
+	for (int row=0; row < 3; row++) {
+		for (int column=0; column < 4; column++) {
+			result.m[row][column] = a.m[row][0] * b.m[0][column]
+				+ a.m[row][1] * b.m[1][column]
+				+ a.m[row][2] * b.m[2][column]
+				+ (column == 3 ? a.m[row][3] : 0.0f);
+		}
+	}
+	return result;
+}
+
+
+inline Transform Transform::translation(const Vector& offset)
+{
+	Transform t;
+	t.m[0][3] = offset.x;
+	t.m[1][3] = offset.y;
+	t.m[2][3] = offset.z;
+	return t;
+}
+
+inline Transform Transform::scaling(const Vector& factors)
+{
+	Transform t;
+	t.m[0][0] = factors.x;
+	t.m[1][1] = factors.y;
+	t.m[2][2] = factors.z;
+	return t;
+}
+
+inline Transform Transform::rotation(const Vector& axis, float angle)
+{
+	Vector a = axis.normalized();
+	float c = std::cos(angle), s = std::sin(angle), k = 1.0f - c;
+
+	Transform t;
+	t.m[0][0] = a.x * a.x * k + c;
+	t.m[0][1] = a.x * a.y * k - a.z * s;
+	t.m[0][2] = a.x * a.z * k + a.y * s;
+	t.m[1][0] = a.y * a.x * k + a.z * s;
+	t.m[1][1] = a.y * a.y * k + c;
+	t.m[1][2] = a.y * a.z * k - a.x * s;
+	t.m[2][0] = a.z * a.x * k - a.y * s;
+	t.m[2][1] = a.z * a.y * k + a.x * s;
+	t.m[2][2] = a.z * a.z * k + c;
+	return t;
+}
+
+inline Transform Transform::inverse() const
+{
+	// inverse of the linear part from its cofactors
+	float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	float invDet = 1.0f / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+
+	Transform inv;
+	inv.m[0][0] = c00 * invDet;
+	inv.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+	inv.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+	inv.m[1][0] = c01 * invDet;
+	inv.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+	inv.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+	inv.m[2][0] = c02 * invDet;
+	inv.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+	inv.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+
+	// and the translation undone: -inverse(linear) * translation
+	Vector translation = inv.applyVector(Vector(m[0][3], m[1][3], m[2][3]));
+	inv.m[0][3] = -translation.x;
+	inv.m[1][3] = -translation.y;
+	inv.m[2][3] = -translation.z;
+	return inv;
+}
@@ -0,0 +1,214 @@
+#include <algorithm>
+
+#include "triangleMesh.h"
+#include "stats.h"
+
+
+TriangleMesh::TriangleMesh(const Color& surfaceColor,
+		const float reflection,
+		const float transparency,
+		const float refractiveIndex,
+		const Color& emissionColor):
+			material(surfaceColor, reflection, transparency, refractiveIndex, emissionColor)
+{
+	arrays = MeshArrays();
+}
+
+
+TriangleMesh::TriangleMesh(const std::vector<Point>& vertices, const std::vector<int>& indices,
+		const Color& surfaceColor,
+		const float reflection,
+		const float transparency,
+		const float refractiveIndex,
+		const Color& emissionColor):
+			TriangleMesh(surfaceColor, reflection, transparency, refractiveIndex, emissionColor)
+{
+	int vertexCount = vertices.size();
+	int triangleCount = indices.size() / 3;
+
+	indexStorage = indices;
+	floatStorage.resize(3 * vertexCount + 6 * triangleCount);
+
+	float* p = floatStorage.data();
+	float *vx = p, *vy = vx + vertexCount, *vz = vy + vertexCount;
+	float *e1x = vz + vertexCount, *e1y = e1x + triangleCount, *e1z = e1y + triangleCount;
+	float *e2x = e1z + triangleCount, *e2y = e2x + triangleCount, *e2z = e2y + triangleCount;
+
+	for (int i=0; i < vertexCount; i++) {
+		vx[i] = vertices[i].x;
+		vy[i] = vertices[i].y;
+		vz[i] = vertices[i].z;
+	}
+
+	std::vector<BoundingBox> boxes(triangleCount);
+
+	for (int i=0; i < triangleCount; i++) {
+		const Point& A = vertices[indices[3*i]];
+		const Point& B = vertices[indices[3*i + 1]];
+		const Point& C = vertices[indices[3*i + 2]];
+
+		e1x[i] = B.x - A.x; e1y[i] = B.y - A.y; e1z[i] = B.z - A.z;
+		e2x[i] = C.x - A.x; e2y[i] = C.y - A.y; e2z[i] = C.z - A.z;
+
+		boxes[i].extend(A);
+		boxes[i].extend(B);
+		boxes[i].extend(C);
+	}
+
+	arrays.vertexCount = vertexCount;
+	arrays.triangleCount = triangleCount;
+	arrays.vx = vx; arrays.vy = vy; arrays.vz = vz;
+	arrays.indices = indexStorage.data();
+	arrays.e1x = e1x; arrays.e1y = e1y; arrays.e1z = e1z;
+	arrays.e2x = e2x; arrays.e2y = e2y; arrays.e2z = e2z;
+
+	bvh.build(boxes);
+}
+
+TriangleMesh::~TriangleMesh()
+{
+}
+
+
+int TriangleMesh::getTriangleCount() const {
+	return arrays.triangleCount;
+}
+
+int TriangleMesh::getVertexCount() const {
+	return arrays.vertexCount;
+}
+
+const MeshArrays& TriangleMesh::getArrays() const {
+	return arrays;
+}
+
+const BVH& TriangleMesh::getBVH() const {
+	return bvh;
+}
+
+
+// Moeller-Trumbore, two sided. Same operations in the same order as
+// intersectMeshTrianglePacket so that packets and single rays agree.
+inline bool TriangleMesh::intersectTriangle(int triangle, const Ray& ray, float tMax, float& t) const {
+
+	STATS_COUNT(STAT_MESH_TRIANGLE_TESTS);
+	const Vector& d = ray.direction;
+
+	// p = cross(d, e2), det = dot(e1, p)
+	float px = d.y*arrays.e2z[triangle] - d.z*arrays.e2y[triangle];
+	float py = d.z*arrays.e2x[triangle] - d.x*arrays.e2z[triangle];
+	float pz = d.x*arrays.e2y[triangle] - d.y*arrays.e2x[triangle];
+	float det = arrays.e1x[triangle]*px + arrays.e1y[triangle]*py + arrays.e1z[triangle]*pz;
+
+	if (det == 0.0f)
+		return false; // ray parallel to the triangle
+
+	float invDet = 1.0f / det;
+
+	int a = arrays.indices[3*triangle];
+	float sx = ray.origin.x - arrays.vx[a];
+	float sy = ray.origin.y - arrays.vy[a];
+	float sz = ray.origin.z - arrays.vz[a];
+	float u = (sx*px + sy*py + sz*pz) * invDet;
+
+	if (u < 0.0f)
+		return false;
+
+	// q = cross(s, e1)
+	float qx = sy*arrays.e1z[triangle] - sz*arrays.e1y[triangle];
+	float qy = sz*arrays.e1x[triangle] - sx*arrays.e1z[triangle];
+	float qz = sx*arrays.e1y[triangle] - sy*arrays.e1x[triangle];
+	float v = (d.x*qx + d.y*qy + d.z*qz) * invDet;
+
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	t = (arrays.e2x[triangle]*qx + arrays.e2y[triangle]*qy + arrays.e2z[triangle]*qz) * invDet;
+
+	return t > RAY_T_MIN && t < tMax;
+}
+
+
+bool TriangleMesh::intersect(Intersection& intersection) {
+
+	bool intersects = bvh.intersect(intersection, [this](int i, Intersection& intersection) {
+		float t;
+		if (!intersectTriangle(i, intersection.ray, intersection.t, t))
+			return false;
+
+		intersection.t = t;
+		intersection.primitiveId = i;
+		return true;
+	});
+
+	if (intersects) {
+		intersection.pShape = this;
+		intersection.color = material.surfaceColor;
+	}
+
+	return intersects;
+}
+
+
+bool TriangleMesh::doesIntersect(const Ray& ray) {
+
+	return bvh.doesIntersect(ray, [this](int i, const Ray& ray) {
+		float t;
+		return intersectTriangle(i, ray, ray.tMax, t);
+	});
+}
+
+
+bool TriangleMesh::occluded(const Ray& ray, float maxDistance, const MaterialProperty*& lens) {
+
+	Ray bounded(ray.origin, ray.direction, maxDistance);
+
+	// one material for the whole mesh, so a transparent mesh only needs a
+	// single hit to be known as a lens
+	if (material.transparency > 0.0f) {
+		if (doesIntersect(bounded))
+			lens = &material;
+		return false;
+	}
+
+	return doesIntersect(bounded);
+}
+
+
+void TriangleMesh::intersectPacket(RayPacket& packet) {
+
+	bvh.intersectPacket(packet, [this](int i, RayPacket& packet) {
+		int a = arrays.indices[3*i];
+		float v0[3] = { arrays.vx[a], arrays.vy[a], arrays.vz[a] };
+		float e1[3] = { arrays.e1x[i], arrays.e1y[i], arrays.e1z[i] };
+		float e2[3] = { arrays.e2x[i], arrays.e2y[i], arrays.e2z[i] };
+
+		int hits = intersectMeshTrianglePacket(packet, v0, e1, e2);
+		STATS_ADD(STAT_MESH_TRIANGLE_TESTS, __builtin_popcount(packet.activeMask));
+		packet.record(hits, this, material.surfaceColor, i);
+	});
+}
+
+
+Vector TriangleMesh::getNormalVector(const Intersection& intersection) {
+
+	int i = intersection.primitiveId;
+	Vector normal = cross(Vector(arrays.e1x[i], arrays.e1y[i], arrays.e1z[i]),
+		Vector(arrays.e2x[i], arrays.e2y[i], arrays.e2z[i]));
+	return normal.normalized();
+}
+
+
+const MaterialProperty& TriangleMesh::getMaterialProperty() {
+	return material;
+}
+
+
+bool TriangleMesh::getBoundingBox(BoundingBox& box) {
+
+	if (bvh.isEmpty())
+		return false;
+
+	box = bvh.getBounds();
+	return true;
+}
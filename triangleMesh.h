@@ -0,0 +1,78 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "vectormath.h"
+#include "color.h"
+#include "ray.h"
+#include "shape.h"
+#include "bvh.h"
+#include "mappedFile.h"
+
+
+// the flat arrays a mesh is made of, all structure of arrays
+struct MeshArrays {
+	int vertexCount, triangleCount;
+
+	const float *vx, *vy, *vz; // shared vertex buffer
+	const int* indices;        // 3 vertex indices per triangle, counter clockwise
+
+	// precomputed edges B-A and C-A of every triangle for Moeller-Trumbore
+	const float *e1x, *e1y, *e1z;
+	const float *e2x, *e2y, *e2z;
+};
+
+
+// Triangles sharing one vertex buffer. Vertices and the per triangle edges
+// are kept in structure of arrays layout and the triangles sit in their own
+// BVH, so a mesh is a single Shape for the scene no matter its size.
+// Hits report the index of the triangle in intersection.primitiveId.
+class TriangleMesh : public Shape
+{
+	friend class MeshCache;
+
+protected:
+	// points either into the storage below or into a mapped cache file
+	MeshArrays arrays;
+	BVH bvh;
+
+	std::vector<float> floatStorage;
+	std::vector<int> indexStorage;
+	std::shared_ptr<MappedFile> mapping;
+
+	MaterialProperty material;
+
+	// empty mesh, MeshCache fills it from a cache file
+	TriangleMesh(const Color& surfaceColor,
+		const float reflection,
+		const float transparency,
+		const float refractiveIndex,
+		const Color& emissionColor);
+
+	inline bool intersectTriangle(int triangle, const Ray& ray, float tMax, float& t) const;
+
+public:
+	TriangleMesh(const std::vector<Point>& vertices, const std::vector<int>& indices,
+		const Color& surfaceColor = Color(1.0f, 1.0f, 1.0f),
+		const float reflection = 0.0f,
+		const float transparency = 0.0f,
+		const float refractiveIndex = 1.0f,
+		const Color& emissionColor = Color(0.0f));
+
+	virtual ~TriangleMesh();
+
+	int getTriangleCount() const;
+	int getVertexCount() const;
+	const MeshArrays& getArrays() const;
+	const BVH& getBVH() const;
+
+	virtual Vector getNormalVector(const Point& pHit) { return Vector(); } // needs the triangle
+	virtual Vector getNormalVector(const Intersection& intersection);
+	virtual const MaterialProperty& getMaterialProperty();
+	virtual bool intersect(Intersection& intersection);
+	virtual bool doesIntersect(const Ray& ray);
+	virtual bool occluded(const Ray& ray, float maxDistance, const MaterialProperty*& lens);
+	virtual bool getBoundingBox(BoundingBox& box);
+	virtual void intersectPacket(RayPacket& packet);
+};
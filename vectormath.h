@@ -1,101 +1,162 @@
 #pragma once
 
+#include <cmath>
+
+// Header only so every operation can be inlined where it's used. The types
+// are trivially copyable plain structs (no virtual functions) that arrays
+// can be built from and the compiler can keep in registers.
+
 struct Vector
 {
-	float x, y, z;
+	float x = 0.0f, y = 1.0f, z = 0.0f; // default is the up vector
 
-	Vector();
-	Vector(const Vector& v);
-	Vector(float x, float y, float z);
-	Vector(float f);
+	constexpr Vector() {}
+	constexpr Vector(float x, float y, float z) : x(x), y(y), z(z) {}
+	constexpr Vector(float f) : x(f), y(f), z(f) {}
 
-	virtual ~Vector();
+	constexpr float length2() const { return x*x + y*y + z*z; }
+	float length() const { return std::sqrt(length2()); }
 
-	inline float length2();
-	inline float length();
+	inline float normalize();
+	inline Vector normalized() const;
 
-	float normalize();
-	Vector normalized();
+	inline Vector& operator +=(const Vector& v);
+	inline Vector& operator -=(const Vector& v);
+	inline Vector& operator *=(float f);
+	inline Vector& operator /=(float f);
+	constexpr Vector operator -() const { return Vector(-x, -y, -z); }
 
-	Vector& operator =(const Vector& v);
-	Vector& operator +=(const Vector& v);
-	Vector& operator -=(const Vector& v);
-	Vector& operator *=(float f);
-	Vector& operator /=(float f);
-	Vector operator -() const;
+	// component access by axis index, 0 = x, 1 = y, 2 = z
+	float operator [](int axis) const { return (&x)[axis]; }
 };
 
-float dot(Vector v1, Vector v2);
-Vector cross(Vector v1, Vector v2);
+typedef Vector Point;
 
-inline Vector operator +(const Vector& v1, const Vector& v2)
+
+constexpr float dot(const Vector& v1, const Vector& v2)
+{
+	return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+}
+
+constexpr Vector cross(const Vector& v1, const Vector& v2)
+{
+	return Vector(v1.y * v2.z - v1.z * v2.y,
+		v1.z * v2.x - v1.x * v2.z,
+		v1.x * v2.y - v1.y * v2.x);
+}
+
+constexpr Vector operator +(const Vector& v1, const Vector& v2)
 {
 	return Vector(v1.x + v2.x,
 		v1.y + v2.y,
 		v1.z + v2.z);
 }
 
-inline Vector operator -(const Vector& v1, const Vector& v2)
+constexpr Vector operator -(const Vector& v1, const Vector& v2)
 {
 	return Vector(v1.x - v2.x,
 		v1.y - v2.y,
 		v1.z - v2.z);
 }
 
-inline Vector operator *(const Vector& v1, const Vector& v2)
+constexpr Vector operator *(const Vector& v1, const Vector& v2)
 {
 	return Vector(v1.x * v2.x,
 		v1.y * v2.y,
 		v1.z * v2.z);
 }
 
-inline Vector operator *(const Vector& v, float f)
+constexpr Vector operator *(const Vector& v, float f)
 {
 	return Vector(v.x * f,
 		v.y * f,
 		v.z * f);
 }
 
-inline Vector operator *(float f, const Vector& v)
+constexpr Vector operator *(float f, const Vector& v)
 {
 	return Vector(f * v.x,
 		f * v.y,
 		f * v.z);
 }
 
-inline Vector operator /(const Vector& v1, const Vector& v2)
+constexpr Vector operator /(const Vector& v1, const Vector& v2)
 {
 	return Vector(v1.x / v2.x,
 		v1.y / v2.y,
 		v1.z / v2.z);
 }
 
-inline Vector operator /(const Vector& v, float f)
+constexpr Vector operator /(const Vector& v, float f)
 {
 	return Vector(v.x / f,
 		v.y / f,
 		v.z / f);
 }
 
-inline Vector operator /(float f, const Vector& v)
+constexpr Vector operator /(float f, const Vector& v)
 {
 	return Vector(f / v.x,
 		f / v.y,
 		f / v.z);
 }
 
-typedef Vector Point;
 
-struct Vector2
+inline Vector& Vector::operator +=(const Vector& v)
 {
-	float u, v;
+	x += v.x;
+	y += v.y;
+	z += v.z;
+	return *this;
+}
 
-	Vector2();
-	Vector2(const Vector2& v);
-	Vector2(float u, float v);
-	Vector2(float f);
+inline Vector& Vector::operator -=(const Vector& v)
+{
+	x -= v.x;
+	y -= v.y;
+	z -= v.z;
+	return *this;
+}
 
-	virtual ~Vector2();
+inline Vector& Vector::operator *=(float f)
+{
+	x *= f;
+	y *= f;
+	z *= f;
+	return *this;
+}
+
+inline Vector& Vector::operator /=(float f)
+{
+	x /= f;
+	y /= f;
+	z /= f;
+	return *this;
+}
+
+inline float Vector::normalize()
+{
+	float l = length();
+
+	*this /= l;
+
+	return l;
+}
+
+inline Vector Vector::normalized() const
+{
+	Vector v(*this);
+	v.normalize();
+	return v;
+}
+
+
+
+struct Vector2
+{
+	float u = 0.0f, v = 0.0f;
 
-	Vector2& operator =(const Vector2& v);
+	constexpr Vector2() {}
+	constexpr Vector2(float u, float v) : u(u), v(v) {}
+	constexpr Vector2(float f) : u(f), v(f) {}
 };
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <vector>
+
+#include "rayTrace.h"
+
+
+// Wavefront version of rayTrace(): instead of following every camera ray
+// down its whole tree of reflections and refractions, each tile runs one
+// stage at a time over all of its rays, generate -> extend (closest hit)
+// -> shade -> shadow, where shade and shadow queue the rays of the next
+// bounce. Every ray carries the factor its color is scaled by on the way
+// back to the camera, so contributions are simply added to the pixel.
+
+
+// one ray of the tree below a pixel
+struct PathRay {
+	Ray ray;
+	float throughput; // product of the reflection and transparency factors so far
+	Color* pixel;
+	int depth;
+};
+
+
+// shadow ray of a hit, waiting for the occlusion stage
+struct ShadowQuery {
+	Ray ray;
+	float lightDistance;
+	Color directColor; // added if the light is visible
+	float throughput;  // of the ray that made the hit
+	float reflection;  // of the hit material, scales what a lens lets through
+	Color* pixel;
+	int depth;
+};
+
+
+// queues of one thread. They are cleared for every tile but keep their
+// memory, so once the first tiles are done the stages don't allocate.
+struct WavefrontArena {
+	std::vector<PathRay> rays, nextRays;
+	std::vector<LightDice> cameraDice; // of the camera rays, in the first round
+	std::vector<Intersection> hits;
+	std::vector<ShadowQuery> shadows;
+};
+
+
+// closest hit of every queued ray, PACKET_SIZE neighbours of the queue at once
+void extendRays(WavefrontArena& arena, Shape* scene, bool usePackets) {
+
+	int rayCount = arena.rays.size();
+	arena.hits.resize(rayCount);
+
+	for (int first = 0; first < rayCount; first += PACKET_SIZE) {
+		int count = std::min(PACKET_SIZE, rayCount - first);
+
+		if (!usePackets) {
+			for (int i=0; i < count; i++) {
+				arena.hits[first+i] = Intersection(arena.rays[first+i].ray);
+				scene->intersect(arena.hits[first+i]);
+			}
+			continue;
+		}
+
+		Ray rays[PACKET_SIZE];
+		for (int i=0; i < count; i++)
+			rays[i] = arena.rays[first+i].ray;
+
+		RayPacket packet(rays, count);
+		scene->intersectPacket(packet);
+
+		for (int i=0; i < count; i++)
+			arena.hits[first+i] = packet.getIntersection(i);
+	}
+}
+
+
+// queues the shadow ray of every hit and the reflected and refracted rays
+// which are worth tracing, see rayWeight(). dice of the rays if they are
+// the camera rays, NULL otherwise.
+void shadeHits(WavefrontArena& arena, const LightSet& lights, const RenderSettings& settings,
+	const LightDice* dice) {
+
+	for (size_t i=0; i < arena.rays.size(); i++) {
+		const PathRay& pathRay = arena.rays[i];
+		const Intersection& intersection = arena.hits[i];
+
+		if (!intersection.intersected())
+			continue;
+
+		HitShading shading = prepareShading(pathRay.ray, intersection, lights, dice ? &dice[i] : NULL);
+		const MaterialProperty& material = *shading.material;
+
+		if (shading.lit)
+			arena.shadows.push_back({ shading.shadowRay, shading.lightDistance, shading.directColor,
+				pathRay.throughput, material.reflection, pathRay.pixel, pathRay.depth });
+		else
+			*pathRay.pixel += shading.directColor * pathRay.throughput;
+
+		if (shading.reflected) {
+			float throughput = pathRay.throughput * material.reflection;
+			float weight = rayWeight(shading.reflectedRay, pathRay.depth + 1, throughput, settings);
+			if (weight > 0.0f) {
+				STATS_RAY(RAY_REFLECTED, pathRay.depth + 1);
+				arena.nextRays.push_back({ shading.reflectedRay, throughput * weight,
+					pathRay.pixel, pathRay.depth + 1 });
+			}
+		}
+
+		if (shading.refracted) {
+			float throughput = pathRay.throughput * material.transparency;
+			float weight = rayWeight(shading.refractedRay, pathRay.depth + 1, throughput, settings);
+			if (weight > 0.0f) {
+				STATS_RAY(RAY_REFRACTED, pathRay.depth + 1);
+				arena.nextRays.push_back({ shading.refractedRay, throughput * weight,
+					pathRay.pixel, pathRay.depth + 1 });
+			}
+		}
+	}
+}
+
+
+// adds the direct light of the hits that see the light, a shadow cast only
+// by transparent objects is traced further as a ray of the next bounce
+void traceShadows(WavefrontArena& arena, Shape* scene, const RenderSettings& settings) {
+
+	for (const auto& query: arena.shadows) {
+		const MaterialProperty* lens = NULL;
+		STATS_RAY(RAY_SHADOW, query.depth);
+		bool inShadow = scene->occluded(query.ray, query.lightDistance, lens);
+
+		if (!inShadow && lens == NULL)
+			*query.pixel += query.directColor * query.throughput;
+
+		else if (!inShadow) {
+			float throughput = query.throughput * lens->transparency * query.reflection;
+			float weight = rayWeight(query.ray, query.depth + 1, throughput, settings);
+			if (weight > 0.0f) {
+				STATS_RAY(RAY_TRANSMITTED, query.depth + 1);
+				arena.nextRays.push_back({ query.ray, throughput * weight, query.pixel, query.depth + 1 });
+			}
+		}
+	}
+}
+
+
+void rayTraceWavefront(Image& image, Camera* camera, Shape* scene, const LightSet& lights,
+	const RenderSettings& settings = RenderSettings()) {
+
+	TileScheduler scheduler(settings.threadCount);
+	std::vector<Tile> tiles = makeTiles(image.getWidth(), image.getFirstRow(),
+		image.getFirstRow() + image.getRowCount(), settings.tileSize);
+	std::vector<WavefrontArena> arenas(scheduler.getThreadCount());
+	std::unique_ptr<Sampler> sampler = makeSampler(settings.sampler, 1);
+
+	scheduler.run(tiles, [&](const Tile& tile, int thread) {
+		WavefrontArena& arena = arenas[thread];
+		arena.rays.clear();
+		arena.cameraDice.clear();
+
+		// same order as rayTrace(), columns of neighbouring rays end up
+		// next to each other in the queue and so in the same packet
+		for (int x = tile.x0; x < tile.x1; x++) {
+			for (int y = tile.y0; y < tile.y1; y++) {
+				float xx = (2.0f*x) / image.getWidth() - 1.0f; // from -1 to 1
+				float yy = (-2.0f*y) / image.getHeight() + 1.0f; // from 1 to -1
+
+				Color* pixel = image.getPixel(x, y);
+				*pixel = Color(0.0f);
+
+				arena.rays.push_back({ camera->makeRay(Vector2(xx, yy)), 1.0f, pixel, 0 });
+				arena.cameraDice.push_back(makeLightDice(*sampler, x, y, 0));
+			}
+		}
+		STATS_RAYS(RAY_CAMERA, 0, arena.rays.size());
+
+		// one bounce per round, until no ray is left
+		for (int round = 0; !arena.rays.empty(); round++) {
+			arena.nextRays.clear();
+			arena.shadows.clear();
+
+			extendRays(arena, scene, settings.usePackets);
+			shadeHits(arena, lights, settings, round == 0 ? arena.cameraDice.data() : NULL);
+			traceShadows(arena, scene, settings);
+
+			std::swap(arena.rays, arena.nextRays);
+		}
+	});
+}